@@ -0,0 +1,104 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Line-based ASCII commands read straight out of a receive ring: a verb and
+// up to maxArgs signed decimal arguments separated by spaces, ended by CR or
+// LF, e.g. "time 90" or "score 2 -1". Nothing is copied, a line that wraps
+// around the end of the ring is read across the wrap.
+// Source provides RxEnd(), RxAt(position) and rxRingSize (see USART_1).
+template<typename Source>
+class CommandReader {
+public:
+	static constexpr uint8_t maxArgs = 3;
+	static constexpr uint16_t maxLine = Source::rxRingSize / 2;
+
+	struct Command {
+		uint64_t verb;   // up to 8 lowercase characters, compare with Verb()
+		uint8_t argc;
+		std::array<int32_t, maxArgs> args;
+	};
+
+	static constexpr uint64_t Verb(const char *name) {
+		uint64_t verb = 0;
+		for (uint8_t i = 0; i < 8 && name[i]; i++)
+			verb |= (uint64_t)(uint8_t)name[i] << (8 * i);
+		return verb;
+	}
+
+	enum Result : uint8_t { None, Ok, Malformed };
+
+	// the next complete line; blank lines are skipped, an overlong one dropped
+	inline Result Next(Command &command) {
+		uint16_t end = Source::RxEnd();
+		while (cursor != end) {
+			uint16_t available = (end + Source::rxRingSize - cursor) % Source::rxRingSize;
+			uint16_t length = 0;
+			while (length < available && !IsEnd(Source::RxAt(cursor + length)))
+				length++;
+			if (length == available) {
+				if (available >= maxLine)
+					cursor = end;
+				return None;
+			}
+			uint16_t start = cursor;
+			cursor = (cursor + length + 1) % Source::rxRingSize;
+			if (length)
+				return Parse(start, length, command) ? Ok : Malformed;
+		}
+		return None;
+	}
+
+private:
+	static inline bool IsEnd(char c) { return c == '\r' || c == '\n'; }
+
+	static inline bool Parse(uint16_t start, uint16_t length, Command &command) {
+		command = {};
+		uint8_t field = 0;   // 0 is the verb
+		uint8_t size = 0;
+		bool negative = false;
+		int32_t value = 0;
+		for (uint16_t i = 0; i <= length; i++) {
+			char c = i < length ? Source::RxAt(start + i) : ' ';
+			if (c == ' ' || c == '\t') {
+				if (size && field) {
+					if (negative && size == 1)
+						return false;   // a lone '-'
+					command.args[command.argc++] = negative ? -value : value;
+				}
+				if (size)
+					field++;
+				size = 0;
+				continue;
+			}
+			if (!size && field > maxArgs)
+				return false;
+			if (!field) {
+				if (size == 8)
+					return false;
+				if (c >= 'A' && c <= 'Z')
+					c += 'a' - 'A';
+				command.verb |= (uint64_t)(uint8_t)c << (8 * size);
+			}
+			else if (!size && c == '-') {
+				negative = true;
+				value = 0;
+			}
+			else if (c >= '0' && c <= '9') {
+				if (size == 9)
+					return false;   // keeps 'value' in range
+				if (!size) {
+					negative = false;
+					value = 0;
+				}
+				value = value * 10 + (c - '0');
+			}
+			else
+				return false;
+			size++;
+		}
+		return command.verb != 0;
+	}
+
+	uint16_t cursor = 0;
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include "Tones.hpp"
+
+// Attack/decay/sustain/release gain of one voice, stepped once a
+// millisecond by MusicPlayer while it is changing. The gain runs from 0
+// to 256 and scales the note's level; a note that starts over a sounding
+// one attacks from where that one was, so nothing jumps.
+class Envelope {
+public:
+	struct Shape {
+		uint16_t attack;    // ms from silence to full
+		uint16_t decay;     // ms from full to silence, stopping at the sustain
+		uint8_t sustain;    // of 255
+		uint16_t release;   // ms from full to silence
+	};
+
+	// by the wave the instrument plays (Tones::Instrument): plucked and
+	// struck families fade, the rest hold
+	static constexpr Shape shapes[Tones::waves] = {
+		{ 4, 200, 180, 40 },     // square: organ, brass, reed, leads
+		{ 2, 600, 70, 150 },     // triangle: piano, bass, pads
+		{ 6, 900, 100, 250 },    // sine: bells, pipes
+		{ 12, 300, 210, 100 },   // sawtooth: guitar, strings
+	};
+
+	static constexpr uint16_t full = 256;
+
+	inline void Start(uint8_t wave) {
+		shape = &shapes[wave < Tones::waves ? wave : (uint8_t)Tones::square];
+		stage = attack;
+	}
+
+	inline void Release() {
+		if (stage != idle)
+			stage = release;
+	}
+
+	inline void Stop() {
+		stage = idle;
+		gain = 0;
+	}
+
+	// one millisecond on
+	inline void Step() {
+		switch (stage) {
+		case attack:
+			gain += Rate(shape->attack);
+			if (gain >= top) {
+				gain = top;
+				stage = decay;
+			}
+			break;
+		case decay: {
+				uint32_t floor = (uint32_t)shape->sustain * top / 255;
+				uint32_t rate = Rate(shape->decay);
+				gain = gain > floor + rate ? gain - rate : floor;
+				if (gain == floor)
+					stage = sustain;
+				break;
+			}
+		case release: {
+				uint32_t rate = Rate(shape->release);
+				gain = gain > rate ? gain - rate : 0;
+				if (!gain)
+					stage = idle;
+				break;
+			}
+		default:
+			break;
+		}
+	}
+
+	inline uint16_t Gain() const { return gain >> 8; }
+	inline bool Moving() const { return stage == attack || stage == decay || stage == release; }
+	inline bool Active() const { return stage != idle; }
+
+private:
+	enum Stage : uint8_t { idle, attack, decay, sustain, release };
+
+	static constexpr uint32_t top = (uint32_t)full << 8;   // gain keeps 8 bits of fraction
+
+	static inline uint32_t Rate(uint16_t ms) { return top / (ms ? ms : 1); }
+
+	const Shape *shape = &shapes[Tones::square];
+	uint32_t gain = 0;
+	Stage stage = idle;
+};
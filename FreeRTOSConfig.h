@@ -70,7 +70,14 @@
 
 #define configUSE_PREEMPTION		                1
 #define configUSE_PORT_OPTIMISED_TASK_SELECTION     1
+#ifdef LOW_POWER
+/* Own vPortSuppressTicksAndSleep (Power.hpp): SysTick halts in STOP mode, the
+RTC keeps time across the sleep instead. */
+#define configUSE_TICKLESS_IDLE                     2
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP       2
+#else
 #define configUSE_TICKLESS_IDLE                     1
+#endif
 #define configUSE_IDLE_HOOK			                0
 #define configUSE_TICK_HOOK			                0
 #define configCPU_CLOCK_HZ			                CLOCK
@@ -78,7 +85,11 @@
 #define configMAX_PRIORITIES		                5
 #define configMINIMAL_STACK_SIZE	                ( ( unsigned short ) 128 )
 #define configMAX_TASK_NAME_LEN		                ( 16 )
+#ifdef TASK_STATS
+#define configUSE_TRACE_FACILITY	                1
+#else
 #define configUSE_TRACE_FACILITY	                0
+#endif
 #define configUSE_16_BIT_TICKS		                0
 #define configIDLE_SHOULD_YIELD		                1
 #define configUSE_TASK_NOTIFICATIONS                1
@@ -87,17 +98,22 @@
 #define configUSE_COUNTING_SEMAPHORES               0
 
 /* Memory allocation related definitions. */
+#ifdef STATIC_MEMORY
+/* Every kernel object is reserved at link time (see rtos.hpp), no heap_x.c
+needs to be linked. */
+#define configSUPPORT_STATIC_ALLOCATION				1
+#define configSUPPORT_DYNAMIC_ALLOCATION			0
+#define configTOTAL_HEAP_SIZE		                ( ( size_t ) 0 )
+#else
 #define configSUPPORT_STATIC_ALLOCATION				0
 #define configSUPPORT_DYNAMIC_ALLOCATION			1
 #define configTOTAL_HEAP_SIZE		                ( ( size_t ) ( 10 * 1024 ) )
+#endif
 #define configAPPLICATION_ALLOCATED_HEAP			0
 #define configCHECK_FOR_STACK_OVERFLOW				2
 
-/* Software timer related definitions. */
-#define configUSE_TIMERS							1
-#define configTIMER_TASK_PRIORITY					3
-#define configTIMER_QUEUE_LENGTH					5
-#define configTIMER_TASK_STACK_DEPTH				configMINIMAL_STACK_SIZE
+/* No software timers, so no timer daemon task: the turn clock is the RTC. */
+#define configUSE_TIMERS							0
 
 /* Co-routine definitions. */
 #define configUSE_CO_ROUTINES 		                0
@@ -115,18 +131,37 @@ to exclude the API function. */
 #define INCLUDE_vTaskDelay                          1
 #define INCLUDE_xTaskGetSchedulerState              1
 #define INCLUDE_xTaskGetCurrentTaskHandle           1
+#ifdef TASK_STATS
+#define INCLUDE_uxTaskGetStackHighWaterMark         1
+#else
 #define INCLUDE_uxTaskGetStackHighWaterMark         0
+#endif
 #define INCLUDE_xTaskGetIdleTaskHandle              0
 #define INCLUDE_eTaskGetState                       0
 #define INCLUDE_xEventGroupSetBitFromISR            1
-#define INCLUDE_xTimerPendFunctionCall              0
 #define INCLUDE_xTaskAbortDelay                     0
 #define INCLUDE_xTaskGetHandle                      0
 #define INCLUDE_xTaskResumeFromISR                  1
-#define INCLUDE_xTimerCreate						1
-#define INCLUDE_xTimerDelete						1
-#define INCLUDE_xTimerReset							1
 
+/* Run-time statistics, see TaskStats.hpp. The counter is TIM1 widened to 32
+bits; uxTaskNumber is otherwise unused, so every switch-in bumps it and it
+reads back as a per-task context switch count. */
+#ifdef TASK_STATS
+#ifdef __cplusplus
+extern "C" {
+#endif
+void vConfigureTimerForRunTimeStats( void );
+unsigned long ulGetRunTimeCounterValue( void );
+#ifdef __cplusplus
+}
+#endif
+#define configGENERATE_RUN_TIME_STATS				1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()	vConfigureTimerForRunTimeStats()
+#define portGET_RUN_TIME_COUNTER_VALUE()			ulGetRunTimeCounterValue()
+#define traceTASK_SWITCHED_IN()						( pxCurrentTCB->uxTaskNumber++ )
+#else
+#define configGENERATE_RUN_TIME_STATS				0
+#endif
 
 #define xPortSysTickHandler SysTick_Handler
 #define xPortPendSVHandler PendSV_Handler
@@ -1,77 +1,313 @@
 #pragma once
+#include <algorithm>
 #include <array>
+#include <type_traits>
+#include "TurnClock.hpp"
+#include "GameHistory.hpp"
+#include "PlayerStats.hpp"
+#include "Seqlock.hpp"
 
 //c++17
-class GameEngine {
+// Every build picks its seat count, clock and timer steps at compile time;
+// see the GameEngine alias at the bottom for this board's choice.
+template<uint8_t MaxPlayers, typename Clock, uint16_t TimerStep, uint16_t TimerMax>
+class BasicGameEngine {
+	static_assert(MaxPlayers >= 2 && MaxPlayers <= 64, "seats are tracked in a 64-bit mask at most");
+	static_assert(TimerStep > 0 && TimerMax % TimerStep == 0, "turn time must step onto TimerMax");
+	
 public:
-	static constexpr uint8_t maxPlayers = 6;
-	inline static uint8_t activePlayers;
+	using Mask = std::conditional_t<(MaxPlayers <= 32), uint32_t, uint64_t>;
+	
+	static constexpr uint8_t maxPlayers = MaxPlayers;
+	inline static uint8_t activePlayers;   // players at the table
 	inline static std::array<int32_t, maxPlayers> playerScore;
 	//static std::array<int32_t, maxPlayers> playerPort;
 	inline static bool countScores;
 	inline static uint8_t currentPlayer;
 	
-	static inline uint8_t timerValue = 0;
+	// seats taken and, of those, still in the rotation (not eliminated)
+	inline static Mask seated = 0;
+	inline static Mask inPlay = 0;
+	inline static bool started = false;   // banks are the players' own from here on
+	inline static bool reversed = false;
+	inline static uint8_t skips = 0;    // turns to pass over on the next switch
+	
+	// PerTurn: every turn gets turnTimeSeconds. The others are chess clocks:
+	// each player starts with a bank of turnTimeSeconds, and after a move
+	// Fischer adds the increment, Bronstein refunds up to the increment, and
+	// Delay only charges time beyond the increment.
+	enum ClockMode : uint8_t { PerTurn, Fischer, Bronstein, Delay, ClockModes };
+	inline static ClockMode clockMode = PerTurn;
+	inline static std::array<int32_t, maxPlayers> playerTime;   // ms left in each bank
+	inline static uint16_t incrementSeconds = 5;
+	
+	static inline TurnClock<Clock> turnClock;
+	static inline PlayerStats<maxPlayers> playerStats;
 	
-	GameEngine() {
+	BasicGameEngine() {
 		activePlayers = 0;
-		playerScore = { -1, -1, -1, -1, -1, -1 };
-		//playerPort = { -1, -1, -1, -1, -1, -1 };
+		playerScore.fill(-1);
 		countScores = false;
 		currentPlayer = 0;
-		timerValue = turnTimeSeconds;
+		ResetBanks();
 	}
 	
+	// takes the lowest free seat
 	static inline void AddPlayer() {
 		if (activePlayers < maxPlayers) {
-			playerScore[activePlayers++] = 0;
+			uint8_t seat = LowestSeat(~seated & allSeats);
+			seated |= Bit(seat);
+			inPlay = seated;
+			activePlayers++;
+			playerTime[seat] = turnTimeSeconds * 1000;
+			playerScore[seat] = 0;
 		}
 	}	
 	
+	// frees the highest seat taken
 	static inline void RemovePlayer() {
 		if (activePlayers > 0) {
-			playerScore[activePlayers--] = -1;
+			uint8_t seat = HighestSeat(seated);
+			seated &= ~Bit(seat);
+			inPlay = seated;
+			activePlayers--;
+			playerScore[seat] = -1;
 		}
 	}
 	
+	// out of the game: keeps the seat and score, drops out of the rotation
+	static inline void Eliminate(uint8_t player) {
+		inPlay &= ~Bit(player);
+	}
+	
+	static inline void Skip() { skips++; }
+	
+	static inline void Reverse() { reversed = !reversed; }
+	
+	// everything a game needs to carry on after a reset
+	struct State {
+		Mask seated;
+		Mask inPlay;
+		uint16_t turnTimeSeconds;
+		uint16_t incrementSeconds;
+		uint8_t currentPlayer;
+		uint8_t clockMode;
+		bool countScores;
+		bool reversed;
+		std::array<int32_t, MaxPlayers> playerScore;
+		std::array<int32_t, MaxPlayers> playerTime;
+	};
+	
+	static inline State Capture() {
+		return State{ seated, inPlay, turnTimeSeconds, incrementSeconds, currentPlayer, clockMode, countScores, reversed, playerScore, playerTime };
+	}
+	
+	// false, and nothing changed, if the state can't be a game in progress
+	static inline bool Restore(const State &state) {
+		Mask inState = state.inPlay & state.seated & allSeats;
+		if (__builtin_popcountll(inState) < 2 || state.currentPlayer >= MaxPlayers || !(inState & Bit(state.currentPlayer)))
+			return false;
+		seated = state.seated & allSeats;
+		inPlay = state.inPlay & seated;
+		activePlayers = __builtin_popcountll(seated);
+		turnTimeSeconds = std::clamp<uint16_t>(state.turnTimeSeconds, timerStep, timerMax);
+		incrementSeconds = state.incrementSeconds;
+		currentPlayer = state.currentPlayer;
+		clockMode = state.clockMode < ClockModes ? ClockMode(state.clockMode) : PerTurn;
+		countScores = state.countScores;
+		reversed = state.reversed;
+		started = true;
+		playerScore = state.playerScore;
+		playerTime = state.playerTime;
+		ResetTurnTimer();
+		return true;
+	}
+	
+	// What other tasks get to see. The turn clock is copied whole, so a
+	// reader works out the live remaining time from its own copy.
+	struct Snapshot {
+		State state;
+		TurnClock<Clock> turnClock;
+	};
+	static_assert(std::is_trivially_copyable_v<Snapshot>, "snapshots are plain copies");
+	
+	// The game task publishes after every change; display, telemetry and
+	// LED readers take tear-free copies without locking.
+	static inline void Publish() { snapshot.Publish(Snapshot{ Capture(), turnClock }); }
+	static inline Snapshot Read() { return snapshot.Read(); }
+	static inline uint32_t Version() { return snapshot.Version(); }
+	
 	static inline auto GetCurrentPlayer() {
 		return currentPlayer;
 	}
 	
+	// whole seconds left, rounded up and held at 0 through overtime
 	static inline auto GetTimerValue() {
-		return std::pair{ timerValue / 60, timerValue % 60 };
+		int32_t remaining = turnClock.RemainingMs();
+		uint32_t seconds = remaining > 0 ? (remaining + 999) / 1000 : 0;
+		return std::pair{ seconds / 60, seconds % 60 };
 	}
 	
 	static inline void IncrementTurnTime() {
-		if (turnTimeSeconds + timerStep <= timerMax)
-			turnTimeSeconds += timerStep;
+		if (turnTimeSeconds + StepAt(turnTimeSeconds) <= timerMax)
+			turnTimeSeconds += StepAt(turnTimeSeconds);
 		else
 			turnTimeSeconds = timerStep;
-		timerValue = turnTimeSeconds;
+		SettingsChanged();
 	}
 	
 	static inline void DecrementTurnTime() {
 		if (turnTimeSeconds > timerStep)
-			turnTimeSeconds -= timerStep;
+			turnTimeSeconds -= StepAt(turnTimeSeconds - 1);
 		else 
 			turnTimeSeconds = timerMax;
-		timerValue = turnTimeSeconds;
+		SettingsChanged();
+	}
+	
+	// rounded down onto the TimerStep grid
+	static inline void SetTurnTime(uint16_t seconds) {
+		turnTimeSeconds = std::clamp<uint16_t>(seconds - seconds % timerStep, timerStep, timerMax);
+		SettingsChanged();
+	}
+	
+	// any seated player, outside the turn order
+	static inline bool AdjustScore(uint8_t player, int32_t delta) {
+		if (player >= maxPlayers || !(seated & Bit(player)))
+			return false;
+		playerScore[player] += delta;
+		return true;
 	}
 	
 	static inline void ChangeScore(int8_t delta) {
 		playerScore[currentPlayer] += delta;
+		lastTurn.scoreDelta += delta;
+	}
+	
+	static inline void NextClockMode() {
+		clockMode = ClockMode((clockMode + 1) % ClockModes);
+		SettingsChanged();
+	}
+	
+	// The banks are filled from the settings once, as the first turn starts;
+	// settings changed mid-game only apply from the next turn on.
+	static inline void StartGame() {
+		if (!started)
+			ResetBanks();
+		started = true;
+	}
+	
+	static inline void ResetBanks() {
+		playerTime.fill(turnTimeSeconds * 1000);
+		ResetTurnTimer();
 	}
 	
 	static inline void ResetTurnTimer() {
-		timerValue = turnTimeSeconds;
+		turnClock.Reset(TurnBudgetMs());
 	}
 	
+	// 'lateMs': how long ago the button press that started the turn happened
+	static inline void StartTurnTimer(uint32_t lateMs = 0) {
+		turnClock.Start(TurnBudgetMs(), lateMs);
+	}
+	
+	// The move is over: charge the bank and apply the increment. Constant
+	// time whatever the player count, only the current bank is touched.
+	static inline void EndTurn(uint32_t lateMs = 0) {
+		turnClock.Pause(lateMs);
+		lastTurn = { currentPlayer, turnClock.ElapsedMs(), 0, turnClock.RemainingMs() < 0 };
+		Settle(true);
+	}
+	
+	// Leaving the turn through the menus: the time is charged, no increment.
+	static inline void SuspendTurn() {
+		turnClock.Pause();
+		Settle(false);
+	}
+	
+	
 	static inline void NextPlayer() {
-		currentPlayer = (currentPlayer + 1) % activePlayers;
+		GameHistory::Append(lastTurn);
+		playerStats.Add(lastTurn);
+		if (inPlay) {
+			for (uint8_t step = 0; step <= skips; step++)
+				currentPlayer = reversed ? PreviousSeat(currentPlayer) : FollowingSeat(currentPlayer);
+		}
+		skips = 0;
 		ResetTurnTimer();
 	}
 protected:
-	static inline uint8_t turnTimeSeconds = 5;
-	static constexpr uint8_t timerMax = 180;
-	static constexpr uint8_t timerStep = 5;
-};
\ No newline at end of file
+	// before the game the banks follow the settings, so the display shows them
+	static inline void SettingsChanged() {
+		if (started)
+			ResetTurnTimer();
+		else
+			ResetBanks();
+	}
+	
+	static inline int32_t TurnBudgetMs() {
+		switch (clockMode) {
+		case PerTurn:
+			return turnTimeSeconds * 1000;
+		case Delay:
+			return playerTime[currentPlayer] + incrementSeconds * 1000;
+		default:
+			return playerTime[currentPlayer];
+		}
+	}
+	
+	static inline void Settle(bool moved) {
+		int32_t used = turnClock.ElapsedMs();
+		int32_t increment = incrementSeconds * 1000;
+		int32_t &bank = playerTime[currentPlayer];
+		switch (clockMode) {
+		case Fischer:
+			bank -= used;
+			if (moved)
+				bank += increment;
+			break;
+		case Bronstein:
+			bank -= used;
+			if (moved)
+				bank += std::min(used, increment);
+			break;
+		case Delay:
+			bank -= std::max<int32_t>(used - increment, 0);
+			break;
+		default:   // PerTurn has no bank to charge
+			break;
+		}
+		ResetTurnTimer();
+	}
+	
+	static inline Seqlock<Snapshot> snapshot;
+	static inline GameHistory::Record lastTurn = {};   // logged once the score is in
+	
+	static constexpr Mask allSeats = ~Mask(0) >> (8 * sizeof(Mask) - MaxPlayers);
+	
+	static inline Mask Bit(uint8_t seat) { return Mask(1) << seat; }
+	static inline uint8_t LowestSeat(Mask mask) { return __builtin_ctzll(mask); }
+	static inline uint8_t HighestSeat(Mask mask) { return 63 - __builtin_clzll(mask); }
+	
+	// Next set bit above 'seat', wrapping to the lowest: a mask and a ctz, no
+	// division. Mask(2) << 63 is 0, so the last seat wraps correctly too.
+	static inline uint8_t FollowingSeat(uint8_t seat) {
+		Mask above = inPlay & ~((Mask(2) << seat) - 1);
+		return LowestSeat(above ? above : inPlay);
+	}
+	
+	static inline uint8_t PreviousSeat(uint8_t seat) {
+		Mask below = inPlay & (Bit(seat) - 1);
+		return HighestSeat(below ? below : inPlay);
+	}
+	
+	static inline uint16_t turnTimeSeconds = 5;
+	static constexpr uint16_t timerMax = TimerMax;
+	static constexpr uint16_t timerStep = TimerStep;
+	
+	// coarser steps for long turns: TimerStep up to 3 min, 30 s up to 10 min, then 1 min
+	static constexpr uint16_t StepAt(uint16_t seconds) {
+		return seconds < 180 ? timerStep : (seconds < 600 ? 30 : 60);
+	}
+};
+
+using GameEngine = BasicGameEngine<6, Periph::Rtc, 5, 3600>;
\ No newline at end of file
@@ -0,0 +1,158 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+
+// Turn log in a fixed RAM ring. Each record is varints relative to the one
+// before it: the duration as a zigzag delta in 0.1 s with three flag bits
+// packed below it, the player only when it is not previous + 1, and the
+// score only when it is nonzero. A typical turn takes 2-3 bytes, so the ring
+// holds a few hundred turns; when it is full the oldest records are dropped.
+class GameHistory {
+public:
+	static constexpr uint16_t capacity = 1024;
+	static constexpr uint16_t maxRecordSize = 8;
+
+	struct Record {
+		uint8_t player;
+		uint32_t durationMs;
+		int16_t scoreDelta;
+		bool overtime;
+	};
+
+	static inline void Clear() {
+		head = used = 0;
+		newest = oldest = State{};
+		firstTurn = turns = 0;
+	}
+
+	// O(1): one record is encoded and at most a few old ones evicted
+	static inline void Append(const Record &record) {
+		std::array<uint8_t, maxRecordSize> encoded;
+		uint8_t size = Encode(record, newest, encoded);
+		while (capacity - used < size)
+			Evict();
+		for (uint8_t i = 0; i < size; i++)
+			bytes[(head + i) % capacity] = encoded[i];
+		head = (head + size) % capacity;
+		used += size;
+		turns++;
+	}
+
+	// visit(turnNumber, record), oldest first
+	template<typename Visit>
+	static inline void ForEach(Visit visit) {
+		State state = oldest;
+		uint16_t position = Tail();
+		for (uint32_t turn = firstTurn; turn < firstTurn + turns; turn++) {
+			Record record;
+			position = Decode(position, state, record);
+			visit(turn, record);
+		}
+	}
+
+	// CSV, one line per turn; sink(data, size) must be done with 'data' on return
+	template<typename Sink>
+	static inline void Export(Sink sink) {
+		static std::array<char, 48> line;
+		int size = snprintf(line.data(), line.size(), "turn,player,ms,score,overtime\r\n");
+		sink(line.data(), (uint16_t)size);
+		ForEach([&sink](uint32_t turn, const Record &record) {
+			int size = snprintf(line.data(), line.size(), "%lu,%u,%lu,%d,%u\r\n", (unsigned long)turn, (unsigned)record.player,
+				(unsigned long)record.durationMs, (int)record.scoreDelta, (unsigned)record.overtime);
+			sink(line.data(), (uint16_t)size);
+		});
+	}
+
+	static inline uint16_t Bytes() { return used; }
+	static inline uint32_t Turns() { return turns; }
+
+private:
+	enum Flags : uint8_t { Overtime = 1 << 0, HasPlayer = 1 << 1, HasScore = 1 << 2, FlagBits = 3 };
+
+	// what the next record is encoded against
+	struct State {
+		uint32_t deciseconds;
+		uint8_t player;
+	};
+
+	static inline uint32_t ZigZag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+	static inline int32_t UnZigZag(uint32_t value) { return (int32_t)(value >> 1) ^ -(int32_t)(value & 1); }
+
+	static inline uint8_t PutVarint(uint32_t value, uint8_t *out) {
+		uint8_t size = 0;
+		while (value >= 0x80) {
+			out[size++] = (value & 0x7F) | 0x80;
+			value >>= 7;
+		}
+		out[size++] = value;
+		return size;
+	}
+
+	static inline uint16_t GetVarint(uint16_t position, uint32_t &value) {
+		value = 0;
+		for (uint8_t shift = 0;; shift += 7) {
+			uint8_t byte = bytes[position];
+			position = (position + 1) % capacity;
+			value |= (uint32_t)(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return position;
+		}
+	}
+
+	static inline uint8_t Encode(const Record &record, State &state, std::array<uint8_t, maxRecordSize> &out) {
+		uint32_t deciseconds = std::min<uint32_t>((record.durationMs + 50) / 100, 0xFFFFFF);
+		uint8_t flags = (record.overtime ? Overtime : 0)
+			| (record.player != (uint8_t)(state.player + 1) ? HasPlayer : 0)
+			| (record.scoreDelta ? HasScore : 0);
+		uint8_t size = PutVarint(ZigZag(deciseconds - state.deciseconds) << FlagBits | flags, out.data());
+		if (flags & HasPlayer)
+			size += PutVarint(record.player, out.data() + size);
+		if (flags & HasScore)
+			size += PutVarint(ZigZag(record.scoreDelta), out.data() + size);
+		state = State{ deciseconds, record.player };
+		return size;
+	}
+
+	static inline uint16_t Decode(uint16_t position, State &state, Record &record) {
+		uint32_t value;
+		position = GetVarint(position, value);
+		uint8_t flags = value & ((1 << FlagBits) - 1);
+		state.deciseconds += UnZigZag(value >> FlagBits);
+		state.player = state.player + 1;
+		if (flags & HasPlayer) {
+			position = GetVarint(position, value);
+			state.player = value;
+		}
+		record.player = state.player;
+		record.durationMs = state.deciseconds * 100;
+		record.overtime = flags & Overtime;
+		record.scoreDelta = 0;
+		if (flags & HasScore) {
+			position = GetVarint(position, value);
+			record.scoreDelta = UnZigZag(value);
+		}
+		return position;
+	}
+
+	// drop the oldest record; its values become the base for the next one
+	static inline void Evict() {
+		Record record;
+		uint16_t tail = Tail();
+		uint16_t next = Decode(tail, oldest, record);
+		used -= (next + capacity - tail) % capacity;
+		firstTurn++;
+		turns--;
+	}
+
+	static inline uint16_t Tail() { return (head + capacity - used) % capacity; }
+
+	static inline std::array<uint8_t, capacity> bytes;
+	static inline uint16_t head = 0;
+	static inline uint16_t used = 0;
+	static inline State newest = {};   // state after the newest record
+	static inline State oldest = {};   // state before the oldest record
+	static inline uint32_t firstTurn = 0;
+	static inline uint32_t turns = 0;
+};
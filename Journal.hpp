@@ -0,0 +1,178 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "utils.hpp"
+
+#ifndef FLASH_JOURNAL_BASE
+// last 4 KB of a 64 KB part, the linker script's FLASH region must end below it
+#define FLASH_JOURNAL_BASE 0x0800F000UL
+#endif
+
+// Log-structured store for Engine::State in a ring of pages in the 4 KB
+// region. A page is as many flash pages as two records need, so the State
+// of a wide table spans several. It starts with a header holding a
+// sequence number and fills up with fixed-size records, each guarded by a
+// CRC. Boot reads the page headers, binary searches the newest page for
+// its first erased slot and steps back over a torn record if the last
+// write was cut off. The page after the active one is kept erased ahead of
+// time, so Append() never waits on an erase; Maintain() does that later,
+// outside the turn switch.
+template<typename Engine>
+class Journal {
+public:
+	using State = typename Engine::State;
+	static_assert(std::is_trivially_copyable_v<State>, "records are copied to and from flash byte by byte");
+
+	// finds the newest intact record and positions the writer after it
+	static inline bool Load(State &state) {
+		bool found = false;
+		uint32_t newest = 0;
+		for (uint8_t page = 0; page < pages; page++) {
+			uint32_t pageSequence;
+			if (HeaderValid(page, pageSequence) && (!found || (int32_t)(pageSequence - newest) > 0)) {
+				found = true;
+				newest = pageSequence;
+				activePage = page;
+			}
+		}
+		hasActive = found;
+		if (!found)
+			return false;
+		sequence = newest;
+
+		// slots are filled in order, so the erased ones form a suffix
+		uint16_t low = 0, high = slots;
+		while (low < high) {
+			uint16_t middle = (low + high) / 2;
+			if (SlotErased(activePage, middle))
+				high = middle;
+			else
+				low = middle + 1;
+		}
+		nextSlot = low;
+		erasePending = !SlotErased(NextPage(), headerSlot);
+
+		for (uint8_t back = 0; back < pages; back++) {
+			uint8_t page = (activePage + pages - back) % pages;
+			uint32_t pageSequence;
+			if (!HeaderValid(page, pageSequence) || pageSequence != sequence - back)
+				break;
+			for (int16_t slot = (back ? slots : nextSlot) - 1; slot >= 0; slot--) {
+				if (ReadRecord(page, slot, state))
+					return true;
+			}
+		}
+		return false;
+	}
+
+	static inline void Append(const State &state) {
+		Periph::Flash::Unlock();
+		if (!hasActive || nextSlot >= slots)
+			OpenPage(hasActive ? NextPage() : 0);
+
+		Record record = {};
+		record.tag = tag;
+		record.state = state;
+		record.crc = Crc(record);
+		std::array<uint16_t, recordSize / 2> words = {};
+		memcpy(words.data(), &record, sizeof(record));
+		// the tag goes first: once it is down the slot counts as used, torn or not
+		uintptr_t address = SlotAddress(activePage, nextSlot);
+		for (uint16_t i = 0; i < words.size(); i++)
+			Periph::Flash::Program(address + 2 * i, words[i]);
+		nextSlot++;
+		Periph::Flash::Lock();
+	}
+
+	// The deferred erase of the page after the active one. Code runs from
+	// flash, so the CPU and every interrupt stall for the whole erase, 20-40 ms
+	// a flash page: ticks are lost and button edges and the RTC alarm are
+	// taken late. The RTC keeps counting, so the turn clock loses nothing.
+	static inline void Maintain() {
+		if (!erasePending)
+			return;
+		Periph::Flash::Unlock();
+		if (!SlotErased(NextPage(), headerSlot))
+			ErasePage(NextPage());
+		Periph::Flash::Lock();
+		erasePending = false;
+	}
+
+private:
+	static constexpr uint16_t tag = 0x5253;
+	static constexpr uint16_t magic = 0x4A4E;
+	static constexpr int16_t headerSlot = -1;
+	static constexpr uint32_t headerSize = 8;
+	static constexpr uint8_t regionFlashPages = 4;
+
+	struct Record {
+		uint16_t tag;
+		uint16_t crc;
+		State state;
+	};
+
+	static constexpr uint32_t recordSize = (sizeof(Record) + 1) & ~1U;
+	static constexpr uint32_t flashPages = (headerSize + 2 * recordSize + Periph::Flash::pageSize - 1) / Periph::Flash::pageSize;
+	static constexpr uint32_t pageSize = flashPages * Periph::Flash::pageSize;
+	static constexpr uint16_t slots = (pageSize - headerSize) / recordSize;
+	static constexpr uint8_t pages = regionFlashPages / flashPages;
+	static_assert(pages >= 2, "Engine::State too large for the journal region");
+
+	static inline uintptr_t PageAddress(uint8_t page) { return FLASH_JOURNAL_BASE + page * pageSize; }
+
+	static inline uintptr_t SlotAddress(uint8_t page, int16_t slot) {
+		return slot == headerSlot ? PageAddress(page) : PageAddress(page) + headerSize + slot * recordSize;
+	}
+
+	static inline uint8_t NextPage() { return (activePage + 1) % pages; }
+
+	static inline bool SlotErased(uint8_t page, int16_t slot) { return Periph::Flash::Read(SlotAddress(page, slot)) == 0xFFFF; }
+
+	// the magic is programmed last, so a valid one means the sequence is complete
+	static inline bool HeaderValid(uint8_t page, uint32_t &pageSequence) {
+		uintptr_t address = PageAddress(page);
+		if (Periph::Flash::Read(address + 4) != magic)
+			return false;
+		pageSequence = Periph::Flash::Read(address) | (uint32_t)Periph::Flash::Read(address + 2) << 16;
+		return true;
+	}
+
+	static inline void OpenPage(uint8_t page) {
+		// only when Maintain() has not caught up yet
+		if (!SlotErased(page, headerSlot))
+			ErasePage(page);
+		sequence++;
+		uintptr_t address = PageAddress(page);
+		Periph::Flash::Program(address, sequence & 0xFFFF);
+		Periph::Flash::Program(address + 2, sequence >> 16);
+		Periph::Flash::Program(address + 4, magic);
+		activePage = page;
+		nextSlot = 0;
+		hasActive = true;
+		erasePending = true;
+	}
+
+	static inline void ErasePage(uint8_t page) {
+		for (uint32_t offset = 0; offset < pageSize; offset += Periph::Flash::pageSize)
+			Periph::Flash::ErasePage(PageAddress(page) + offset);
+	}
+
+	static inline bool ReadRecord(uint8_t page, uint16_t slot, State &state) {
+		Record record;
+		memcpy(&record, reinterpret_cast<const void*>(SlotAddress(page, slot)), sizeof(record));
+		if (record.tag != tag || record.crc != Crc(record))
+			return false;
+		state = record.state;
+		return true;
+	}
+
+	static inline uint16_t Crc(const Record &record) { return utils::crc16(&record.state, sizeof(State)); }
+
+	static inline uint8_t activePage = 0;
+	static inline uint16_t nextSlot = 0;
+	static inline uint32_t sequence = 0;
+	static inline bool hasActive = false;
+	static inline bool erasePending = false;
+};
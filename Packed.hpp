@@ -0,0 +1,148 @@
+#pragma once
+#include <cstdint>
+#include "Tones.hpp"
+
+// Packed tracks: the compiled events (Tones::Event, 8 bytes each) as a byte
+// stream of tokens, written by tools/playtunec and read back one event at
+// a time by Tones::Unpacker. Host-safe, shared with tools/playtunec.
+//
+// A token starts with a byte whose top two bits give its type:
+//   00vvvdww note   voice v plays pitches[next byte] at defaultDuty, wave w
+//   01vvvd00 off    voice v falls silent
+//   10nnnnnn copy   the n + 1 tokens 'distance' bytes back (varint next),
+//                   counted from this token's first byte, play again
+//   11kkkd00 escape k: 0 end of track, 1 wait, 2 any other event as
+//                   voice, duty, period (3 bytes, LSB first), instrument,
+//                   3 a note at another level as 00000www|voice<<3 with
+//                   wave w, note, duty
+// A set d bit means a varint delay in ms follows the token, 0 otherwise.
+// Varints are 7 bits a byte, LSB first, the high bit set on all but the
+// last. Copies only point at runs of plain tokens, never at another copy,
+// so a repeated phrase costs two or three bytes and the reader needs one
+// return position, no window of decoded history.
+namespace Tones
+{
+	namespace Packed
+	{
+		constexpr uint8_t format = 2;   // bump with any change above
+
+		enum Type : uint8_t {
+			note = 0x00,
+			off = 0x40,
+			copy = 0x80,
+			escape = 0xC0,
+			typeMask = 0xC0,
+		};
+
+		enum Escape : uint8_t {
+			end = escape | 0 << 3,
+			wait = escape | 1 << 3,
+			event = escape | 2 << 3,
+			level = escape | 3 << 3,
+		};
+
+		constexpr uint8_t hasDelay = 0x04;
+		constexpr uint8_t voiceShift = 3;
+		constexpr uint8_t waveMask = 0x03;
+		constexpr uint8_t maxCopy = 64;   // tokens
+		static_assert(channels <= 8 && waves <= waveMask + 1, "the note and off tokens hold 3 bits of voice, 2 of wave");
+	}
+
+	// Reads a packed track ahead of the player by one event, so the delay
+	// of the next is known; the whole state is these few words.
+	class Unpacker {
+	public:
+		inline void Start(const uint8_t *track) {
+			data = track;
+			position = 0;
+			remaining = 0;
+			ahead = Read();
+		}
+
+		inline const Event &Peek() const { return ahead; }
+
+		inline Event Take() {
+			Event event = ahead;
+			if (event.channel != endOfTrack)
+				ahead = Read();
+			return event;
+		}
+
+	private:
+		inline Event Read() {
+			uint32_t at = position;
+			if ((data[at] & Packed::typeMask) == Packed::copy) {
+				position++;
+				uint32_t distance = Varint();
+				resume = position;
+				remaining = (data[at] & ~Packed::typeMask) + 1;
+				position = at - distance;
+			}
+			Event event = Literal();
+			if (remaining && !--remaining)
+				position = resume;
+			return event;
+		}
+
+		inline Event Literal() {
+			uint8_t token = data[position++];
+			Event event = {};
+			uint8_t voice = token >> Packed::voiceShift & 7;
+			switch (token & Packed::typeMask) {
+			case Packed::note:
+				event.channel = voice;
+				event.duty = defaultDuty;
+				event.period = periods[data[position++]];
+				event.instrument = token & Packed::waveMask;
+				break;
+			case Packed::off:
+				event.channel = voice;
+				break;
+			default:
+				switch (token & ~Packed::hasDelay) {
+				case Packed::end:
+					event.channel = endOfTrack;
+					break;
+				case Packed::wait:
+					event.channel = wait;
+					break;
+				case Packed::level:
+					event.channel = data[position] >> Packed::voiceShift;
+					event.instrument = data[position] & 7;
+					event.period = periods[data[position + 1]];
+					event.duty = data[position + 2];
+					position += 3;
+					break;
+				default:
+					event.channel = data[position++];
+					event.duty = data[position++];
+					event.period = data[position] | data[position + 1] << 8 | data[position + 2] << 16;
+					event.instrument = data[position + 3];
+					position += 4;
+					break;
+				}
+			}
+			if (token & Packed::hasDelay)
+				event.delay = Varint();
+			return event;
+		}
+
+		inline uint32_t Varint() {
+			uint32_t value = 0;
+			for (uint8_t shift = 0;; shift += 7) {
+				uint8_t byte = data[position++];
+				value |= (uint32_t)(byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+					return value;
+			}
+		}
+
+		static constexpr auto periods = Periods();
+
+		const uint8_t *data = nullptr;
+		uint32_t position = 0;   // of the next token
+		uint32_t resume = 0;     // after the copy being played
+		uint8_t remaining = 0;   // tokens left of it, 0 outside one
+		Event ahead = {};
+	};
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include "GameHistory.hpp"
+
+// Running per-player turn statistics, updated once per turn with Welford's
+// method so no turn log is needed. The mean is kept in 1/16 ms and the sum
+// of squared deviations in 1/256 ms^2, both fixed point.
+template<uint8_t MaxPlayers>
+class PlayerStats {
+public:
+	struct Player {
+		uint16_t turns;
+		uint16_t overtimes;
+		int32_t mean;       // 1/16 ms
+		uint64_t m2;        // 1/256 ms^2
+		uint32_t minMs;
+		uint32_t maxMs;
+	};
+
+	static constexpr uint8_t fractionBits = 4;
+
+	inline void Clear() { players.fill(Player{}); }
+
+	// O(1): one division, no history
+	inline void Add(const GameHistory::Record &record) {
+		if (record.player >= MaxPlayers)
+			return;
+		Player &p = players[record.player];
+		int32_t x = (int32_t)std::min<uint32_t>(record.durationMs, INT32_MAX >> fractionBits) << fractionBits;
+		p.turns++;
+		int32_t delta = x - p.mean;
+		p.mean += delta / p.turns;
+		p.m2 += (int64_t)delta * (x - p.mean);
+		if (p.turns == 1 || record.durationMs < p.minMs)
+			p.minMs = record.durationMs;
+		if (record.durationMs > p.maxMs)
+			p.maxMs = record.durationMs;
+		if (record.overtime)
+			p.overtimes++;
+	}
+
+	inline const Player &Get(uint8_t player) const { return players[player]; }
+
+	inline uint32_t MeanMs(uint8_t player) const { return players[player].mean >> fractionBits; }
+
+	// sample standard deviation
+	inline uint32_t StdDevMs(uint8_t player) const {
+		const Player &p = players[player];
+		if (p.turns < 2)
+			return 0;
+		return Sqrt(p.m2 / (p.turns - 1)) >> fractionBits;
+	}
+
+	inline uint16_t OvertimePermille(uint8_t player) const {
+		const Player &p = players[player];
+		return p.turns ? (uint32_t)p.overtimes * 1000 / p.turns : 0;
+	}
+
+	// CSV, one line per player that has played; same sink contract as GameHistory::Export
+	template<typename Sink>
+	inline void Export(Sink sink) const {
+		static std::array<char, 64> line;
+		int size = snprintf(line.data(), line.size(), "player,turns,mean_ms,stddev_ms,min_ms,max_ms,overtime_pct\r\n");
+		sink(line.data(), (uint16_t)size);
+		for (uint8_t i = 0; i < MaxPlayers; i++) {
+			if (!players[i].turns)
+				continue;
+			uint16_t overtime = OvertimePermille(i);
+			size = snprintf(line.data(), line.size(), "%u,%u,%lu,%lu,%lu,%lu,%u.%u\r\n", (unsigned)i, (unsigned)players[i].turns,
+				(unsigned long)MeanMs(i), (unsigned long)StdDevMs(i), (unsigned long)players[i].minMs, (unsigned long)players[i].maxMs,
+				(unsigned)(overtime / 10), (unsigned)(overtime % 10));
+			sink(line.data(), (uint16_t)size);
+		}
+	}
+
+private:
+	// bit-by-bit integer square root, 32 iterations at most
+	static inline uint32_t Sqrt(uint64_t value) {
+		uint64_t root = 0;
+		uint64_t bit = 1ULL << 62;
+		while (bit > value)
+			bit >>= 2;
+		while (bit) {
+			if (value >= root + bit) {
+				value -= root + bit;
+				root = (root >> 1) + bit;
+			}
+			else
+				root >>= 1;
+			bit >>= 2;
+		}
+		return root;
+	}
+
+	std::array<Player, MaxPlayers> players = {};
+};
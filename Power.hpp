@@ -0,0 +1,137 @@
+#pragma once
+#include <array>
+
+// LOW_POWER: the idle task drops into STOP (or SLEEP, while something still
+// needs the fast clocks) until the next kernel timeout, with the RTC alarm as
+// the wakeup source and the RTC as the tick reference across the sleep.
+class Power {
+public:
+	// peripherals that stop working in STOP mode register while busy
+	enum ClockUser : uint8_t { Sound = 1 << 0 };
+
+	struct Stats {
+		uint32_t wakeups;   // every return from WFI
+		uint32_t stops;     // of those, how many came out of STOP
+		uint32_t asleep;    // Rtc::frequency units spent in WFI
+	};
+
+	static constexpr TickType_t stopMinTicks = pdMS_TO_TICKS(10);   // HSE + PLL restart is ~2 ms
+	static constexpr TickType_t maxSleepTicks = pdMS_TO_TICKS(60000);
+
+	static inline void Require(ClockUser user) {
+		taskENTER_CRITICAL();
+		clockUsers |= user;
+		taskEXIT_CRITICAL();
+	}
+
+	static inline void Release(ClockUser user) {
+		taskENTER_CRITICAL();
+		clockUsers &= ~user;
+		taskEXIT_CRITICAL();
+	}
+
+	static inline void ReleaseFromISR(ClockUser user) {
+		UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+		clockUsers &= ~user;
+		taskEXIT_CRITICAL_FROM_ISR(mask);
+	}
+
+	static inline Stats GetStats() {
+		taskENTER_CRITICAL();
+		Stats copy = stats;
+		taskEXIT_CRITICAL();
+		return copy;
+	}
+
+#if configUSE_TICKLESS_IDLE == 2
+	// the RTC itself is already running for the turn clock
+	static inline void Init() {
+		Periph::Rtc::EnableAlarmInterrupt();
+	}
+
+	// Called by the kernel from the idle task with the scheduler suspended.
+	static inline void Sleep(TickType_t expectedIdle) {
+		if (expectedIdle > maxSleepTicks)
+			expectedIdle = maxSleepTicks;
+		// keep one tick for the entry and exit work
+		uint32_t counts = (uint64_t)(expectedIdle - 1) * Periph::Rtc::frequency / configTICK_RATE_HZ;
+
+		__disable_irq();
+		if (eTaskConfirmSleepModeStatus() == eAbortSleep) {
+			__enable_irq();
+			return;
+		}
+		if (counts < 2) {
+			// too short to be worth stopping SysTick, it wakes us itself
+			__DSB();
+			__WFI();
+			stats.wakeups++;
+			__enable_irq();
+			return;
+		}
+
+		SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+		uint32_t start = Periph::Rtc::Now();
+		Periph::Rtc::SetAlarm(start + counts);
+
+		bool stop = expectedIdle >= stopMinTicks && StopAllowed();
+		if (stop) {
+			PWR->CR &= ~PWR_CR_PDDS;
+			PWR->CR |= PWR_CR_LPDS | PWR_CR_CWUF;   // regulator in low-power mode
+			SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+		}
+		__DSB();
+		__WFI();
+		__ISB();
+		if (stop) {
+			SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+			RCC_Resume();
+			Periph::Rtc::Sync();
+			stats.stops++;
+		}
+
+		// carry the remainder so the tick count never drifts from the RTC
+		uint32_t elapsed = Periph::Rtc::Now() - start;
+		uint32_t scaled = elapsed * configTICK_RATE_HZ + carry;
+		TickType_t ticks = scaled / Periph::Rtc::frequency;
+		carry = scaled % Periph::Rtc::frequency;
+		if (ticks > expectedIdle - 1) {
+			ticks = expectedIdle - 1;
+			carry = 0;
+		}
+		vTaskStepTick(ticks);
+
+		SysTick->VAL = 0;
+		SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+		stats.wakeups++;
+		stats.asleep += elapsed;
+		__enable_irq();
+	}
+#endif // configUSE_TICKLESS_IDLE == 2
+
+private:
+#if configUSE_TICKLESS_IDLE == 2
+	// a DMA transfer still draining or a tone playing needs the clocks
+	static inline bool StopAllowed() {
+		if (clockUsers)
+			return false;
+		const std::array<DMA_Channel_TypeDef*, 7> dma = { DMA1_Channel1, DMA1_Channel2, DMA1_Channel3, DMA1_Channel4,
+			DMA1_Channel5, DMA1_Channel6, DMA1_Channel7 };
+		for (auto channel : dma) {
+			if ((channel->CCR & DMA_CCR_EN) && channel->CNDTR != 0 && !(channel->CCR & DMA_CCR_CIRC))
+				return false;
+		}
+		return true;
+	}
+#endif // configUSE_TICKLESS_IDLE == 2
+
+	static inline volatile uint8_t clockUsers = 0;
+	static inline uint32_t carry = 0;   // tick fraction left over from the last sleep
+	static inline Stats stats = {};
+};
+
+#if configUSE_TICKLESS_IDLE == 2
+extern "C" void vPortSuppressTicksAndSleep(TickType_t xExpectedIdleTime) {
+	Power::Sleep(xExpectedIdleTime);
+}
+#endif
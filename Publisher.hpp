@@ -0,0 +1,121 @@
+#pragma once
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include "Telemetry.hpp"
+
+// Change-driven telemetry of the GameEngine snapshot. Every Update()
+// compares the fields with what was last sent and emits a Delta with just
+// the changed ones, nothing if none changed; every keyframePeriod the full
+// state goes out as a Keyframe so a receiver that joins late can sync up.
+// The remaining turn time is in whole seconds, the resolution the display
+// shows. While the clock runs the receiver counts it down itself, so it is
+// only sent when the clock starts, resumes or stops, and in keyframes.
+template<typename Engine>
+class Publisher {
+public:
+	static constexpr uint8_t seats = Engine::maxPlayers;
+	static constexpr uint8_t fields = Telemetry::FieldCount(seats);
+	static constexpr uint8_t maskSize = (fields + 6) / 7;   // bytes of a full field mask
+	using FieldMask = std::bitset<fields>;
+
+	static constexpr TickType_t keyframePeriod = pdMS_TO_TICKS(10000);
+
+	// ticks until the next keyframe falls due, 0 if it already has
+	inline TickType_t NextDue(TickType_t now) const {
+		TickType_t since = now - lastKeyframe;
+		return !synced || since >= keyframePeriod ? 0 : keyframePeriod - since;
+	}
+
+	// send(frame) gets every frame to go out
+	template<typename Send>
+	inline void Update(const typename Engine::Snapshot &snapshot, TickType_t now, Send send) {
+		std::array<int64_t, fields> values;
+		Collect(snapshot, values);
+		FieldMask changed;
+		for (uint8_t i = 0; i < fields; i++)
+			changed[i] = values[i] != sent[i];
+		bool running = snapshot.turnClock.Running();
+		uint32_t startedAt = snapshot.turnClock.StartedAt();
+		if (running != wasRunning || (running && startedAt != lastStart))
+			changed.set(Telemetry::Remaining);
+		else if (running)
+			changed.reset(Telemetry::Remaining);
+		wasRunning = running;
+		lastStart = startedAt;
+		bool keyframe = !synced || now - lastKeyframe >= keyframePeriod;
+		if (keyframe) {
+			changed.set();
+			lastKeyframe = now;
+			synced = true;
+		}
+		if (changed.any())
+			Emit(keyframe ? Telemetry::Keyframe : Telemetry::Delta, changed, values, send);
+		sent = values;
+	}
+
+private:
+	static inline void Collect(const typename Engine::Snapshot &snapshot, std::array<int64_t, fields> &values) {
+		const auto &state = snapshot.state;
+		int32_t remaining = snapshot.turnClock.RemainingMs();
+		values[Telemetry::Seated] = state.seated;
+		values[Telemetry::InPlay] = state.inPlay;
+		values[Telemetry::Player] = state.currentPlayer;
+		values[Telemetry::TurnTime] = state.turnTimeSeconds;
+		values[Telemetry::Increment] = state.incrementSeconds;
+		values[Telemetry::Mode] = state.clockMode;
+		values[Telemetry::Flags] = (state.countScores ? Telemetry::CountScores : 0) | (state.reversed ? Telemetry::Reversed : 0)
+			| (snapshot.turnClock.Running() ? Telemetry::Running : 0);
+		// rounded up, and down into overtime, as on the display
+		values[Telemetry::Remaining] = remaining > 0 ? (remaining + 999) / 1000 : remaining / 1000;
+		for (uint8_t seat = 0; seat < seats; seat++) {
+			values[Telemetry::ScoreField(seat)] = state.playerScore[seat];
+			values[Telemetry::BankField(seats, seat)] = state.playerTime[seat];
+		}
+	}
+
+	static inline uint8_t VarintSize(uint64_t value) {
+		uint8_t size = 1;
+		while (value >= 0x80) {
+			value >>= 7;
+			size++;
+		}
+		return size;
+	}
+
+	static inline uint64_t ZigZag(int64_t value) { return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); }
+
+	// as many of the 'changed' fields per frame as fit, lowest first
+	template<typename Send>
+	static inline void Emit(Telemetry::Type type, FieldMask changed, const std::array<int64_t, fields> &values, Send send) {
+		while (changed.any()) {
+			uint8_t room = Telemetry::maxPayload - (type == Telemetry::Keyframe ? 1 : 0) - maskSize;
+			FieldMask mask;
+			for (uint8_t i = 0; i < fields && room; i++) {
+				if (!changed[i])
+					continue;
+				uint8_t size = VarintSize(ZigZag(values[i]));
+				if (size > room)
+					break;
+				room -= size;
+				mask.set(i);
+			}
+			Telemetry::Frame frame(type);
+			if (type == Telemetry::Keyframe)
+				frame.Put8(seats);
+			frame.PutVarint(mask);
+			for (uint8_t i = 0; i < fields; i++) {
+				if (mask[i])
+					frame.PutSigned(values[i]);
+			}
+			send(frame);
+			changed &= ~mask;
+		}
+	}
+
+	std::array<int64_t, fields> sent = {};
+	TickType_t lastKeyframe = 0;
+	uint32_t lastStart = 0;   // turn clock stretch Remaining was last sent for
+	bool wasRunning = false;
+	bool synced = false;
+};
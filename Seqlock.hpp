@@ -0,0 +1,54 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single-writer snapshot of a trivially copyable T that any number of tasks
+// or ISRs can read without locks and without ever blocking the writer.
+// There are two slots: Publish() fills the one readers are not pointed at
+// and then flips 'sequence' to it, so a writer preempting a reader only
+// costs that reader a retry, and a reader preempting the writer still sees
+// the previous, complete value.
+template<typename T>
+class Seqlock {
+	static_assert(std::is_trivially_copyable_v<T>, "snapshots are copied word by word");
+
+public:
+	// single writer only
+	inline void Publish(const T &value) {
+		uint32_t next = sequence.load(std::memory_order_relaxed) + 1;
+		std::array<uint32_t, words> buffer = {};
+		memcpy(buffer.data(), &value, sizeof(T));
+		auto &slot = slots[next & 1];
+		for (uint16_t i = 0; i < words; i++)
+			slot[i].store(buffer[i], std::memory_order_relaxed);
+		sequence.store(next, std::memory_order_release);
+	}
+
+	// retries only if a Publish() ran in between, i.e. the writer preempted us
+	inline T Read() const {
+		std::array<uint32_t, words> buffer;
+		uint32_t version;
+		do {
+			version = sequence.load(std::memory_order_acquire);
+			auto &slot = slots[version & 1];
+			for (uint16_t i = 0; i < words; i++)
+				buffer[i] = slot[i].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+		} while (sequence.load(std::memory_order_relaxed) != version);
+		T value;
+		memcpy(static_cast<void*>(&value), buffer.data(), sizeof(T));   // T may have member initializers
+		return value;
+	}
+
+	// changes with every Publish(), lets a reader skip unchanged state
+	inline uint32_t Version() const { return sequence.load(std::memory_order_acquire); }
+
+private:
+	static constexpr uint16_t words = (sizeof(T) + 3) / 4;
+
+	std::array<std::array<std::atomic<uint32_t>, words>, 2> slots = {};
+	std::atomic<uint32_t> sequence = 0;
+};
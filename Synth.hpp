@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <periph.hpp>
+#include <task.h>
+#include <Tones.hpp>
+
+// WAVETABLE output stage: every voice mixed in software into one PWM DAC
+// (Periph::PwmDac, PA1), so a track gets all its voices on one pin and its
+// instruments as timbres. Each voice steps a 32-bit phase through a small
+// wavetable; the DMA interrupt mixes the half of the buffer that has just
+// gone out while the other half plays, 3.6 ms of samples at a time.
+class Synth {
+public:
+	static constexpr uint8_t count = Tones::channels;
+	static constexpr uint16_t blockSize = 64;   // samples per half buffer
+	static constexpr uint8_t waveBits = 6;      // 64 samples per wavetable
+	using Wavetable = std::array<int8_t, 1 << waveBits>;
+
+	static inline void Init() {
+		using Periph::OutPin;
+		OutPin(*GPIOA, 1, OutPin::AFpushpull, OutPin::MHz50);
+		Periph::PwmDac::Init();
+	}
+
+	// half a buffer of silence, then the voices
+	static inline void Start() {
+		buffer.fill(Periph::PwmDac::middle);
+		Periph::PwmDac::Start(buffer.data(), buffer.size());
+	}
+
+	static inline void Stop() {
+		Silence();
+		Periph::PwmDac::Stop();
+	}
+
+	// The phase runs on through a new period, so a retune does not click.
+	// The duty is the voice's amplitude, 128 (the default) a quarter of the
+	// range.
+	static inline void Set(uint8_t index, const Tones::Event &event) {
+		Voice &voice = voices[index];
+		if (!event.duty || !event.period) {
+			voice.level = 0;
+			return;
+		}
+		voice.step = stepScale / event.period;
+		voice.wave = wavetables[event.instrument < Tones::waves ? event.instrument : (uint8_t)Tones::square].data();
+		voice.level = event.duty;
+	}
+
+	// a sounding voice's amplitude, cheap enough for every envelope step
+	static inline void Level(uint8_t index, uint8_t level) {
+		if (voices[index].level)
+			voices[index].level = level;
+	}
+
+	static inline void Silence() {
+		for (Voice &voice : voices)
+			voice.level = 0;
+	}
+
+	// DMA1_Channel2: refills the half (or, late, both) that went out
+	static void HandleInterrupt() {
+		uint32_t halves = Periph::PwmDac::TakeHalves();
+		for (uint8_t half = 0; half < 2; half++) {
+			if (!(halves & (1U << half)))
+				continue;
+#ifdef TASK_STATS
+			uint32_t start = Periph::CycleCounter::Now();
+			Mix(&buffer[half * blockSize]);
+			uint32_t cycles = Periph::CycleCounter::Now() - start;
+			stats.blocks++;
+			stats.cycles += cycles;
+			stats.worst = std::max(stats.worst, cycles);
+#else
+			Mix(&buffer[half * blockSize]);
+#endif // TASK_STATS
+		}
+	}
+
+#ifdef TASK_STATS
+	struct Stats {
+		uint32_t blocks;   // of blockSize samples
+		uint64_t cycles;   // SYSCLK cycles spent mixing them
+		uint32_t worst;    // the longest block
+	};
+
+	static inline Stats GetStats() {
+		taskENTER_CRITICAL();
+		Stats copy = stats;
+		taskEXIT_CRITICAL();
+		return copy;
+	}
+#endif // TASK_STATS
+
+private:
+	// The kernel. Voice by voice, so its phase, step, wave and level stay in
+	// registers: one table load, a multiply-accumulate and a phase add per
+	// sample. The sum is offset to the middle and clipped; four voices in
+	// phase at the default level fill the range.
+	static inline void Mix(uint16_t *out) {
+		mixed.fill(0);
+		for (Voice &voice : voices) {
+			if (!voice.level)
+				continue;
+			const int8_t *wave = voice.wave;
+			uint32_t phase = voice.phase;
+			uint32_t step = voice.step;
+			int32_t level = voice.level;
+			for (int32_t &sample : mixed) {
+				sample += wave[phase >> (32 - waveBits)] * level;
+				phase += step;
+			}
+			voice.phase = phase;
+		}
+		for (uint16_t i = 0; i < blockSize; i++)
+			out[i] = std::clamp<int32_t>((mixed[i] >> mixShift) + Periph::PwmDac::middle, 0, Periph::PwmDac::resolution - 1);
+	}
+
+	static constexpr uint8_t mixShift = 5;
+
+	// phase step per sample = stepScale / period: 2^32 turns of the phase
+	// times the note's frequency (Tones::clock * 256 / period) over the rate
+	static_assert(SYSCLK % Tones::clock == 0, "stepScale needs a whole SYSCLK / Tones::clock");
+	static constexpr uint64_t stepScale = ((uint64_t)Periph::PwmDac::resolution << (32 + Tones::periodShift)) / (SYSCLK / Tones::clock);
+	static_assert(stepScale / Tones::Periods()[Tones::lastNamedNote] < 0x80000000U, "top note above half the sample rate");
+
+	// one period each, in Tones::Wave order, built by the compiler
+	static constexpr auto wavetables = [] {
+		auto level = [](double value) { return (int8_t)(value < 0 ? 127 * value - 0.5 : 127 * value + 0.5); };
+		std::array<Wavetable, Tones::waves> tables = {};
+		constexpr int size = 1 << waveBits;
+		for (int i = 0; i < size; i++) {
+			double turns = (double)i / size;
+			tables[Tones::square][i] = level(i < size / 2 ? 1 : -1);
+			tables[Tones::triangle][i] = level(turns < 0.5 ? 4 * turns - 1 : 3 - 4 * turns);
+			tables[Tones::sine][i] = level(Tones::Sine(turns));
+			tables[Tones::sawtooth][i] = level(2 * turns - 1);
+		}
+		return tables;
+	}();
+
+	struct Voice {
+		const int8_t *wave;   // set with the first level
+		uint32_t phase;       // 2^32 is one period
+		uint32_t step;        // phase per sample
+		uint8_t level;        // 0 is silent
+	};
+	static inline std::array<Voice, count> voices = {};
+
+	static inline std::array<uint16_t, 2 * blockSize> buffer = {};   // DAC samples, DMA reads it round and round
+	static inline std::array<int32_t, blockSize> mixed = {};
+#ifdef TASK_STATS
+	static inline Stats stats = {};
+#endif // TASK_STATS
+};
@@ -0,0 +1,124 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+// TASK_STATS instrumentation: every reportPeriod a low-priority task prints one
+// line per task over USART_1 - stack high-water mark (words never used), CPU
+// share since the previous report and context switches since boot - plus the
+// heap's minimum-ever-free (and, with LOW_POWER, the wakeup rate and time
+// asleep; with WAVETABLE, the synth's mixing cycles per sample and CPU
+// share). Use it to size Rtos::Task stacks instead of guessing.
+#ifdef TASK_STATS
+class TaskStats {
+public:
+	static constexpr uint8_t maxTasks = 10;
+	static constexpr TickType_t reportPeriod = pdMS_TO_TICKS(5000);
+	static constexpr UBaseType_t priority = tskIDLE_PRIORITY + 1;
+
+	static inline void Start(Periph::USART_1 &port) {
+		usart = &port;
+		reporter.Create(vTaskReport, "Stats", priority);
+	}
+
+private:
+	struct Sample {
+		TaskHandle_t handle;
+		uint32_t runTime;
+	};
+
+	static void vTaskReport(void *) {
+		TickType_t xLastWakeTime = xTaskGetTickCount();
+		while (1) {
+			vTaskDelayUntil(&xLastWakeTime, reportPeriod);
+			Report();
+		}
+	}
+
+	static void Report() {
+		uint32_t totalTime = 0;
+		UBaseType_t count = uxTaskGetSystemState(status.data(), status.size(), &totalTime);
+		uint32_t elapsed = totalTime - lastTotal;
+		lastTotal = totalTime;
+
+#if configSUPPORT_DYNAMIC_ALLOCATION
+		Write("stats t=%lus heap-min=%u\r\n", (unsigned long)(totalTime / Periph::Timebase::frequency), (unsigned)xPortGetMinimumEverFreeHeapSize());
+#else
+		Write("stats t=%lus heap-min=static\r\n", (unsigned long)(totalTime / Periph::Timebase::frequency));
+#endif
+
+#ifdef LOW_POWER
+		Power::Stats power = Power::GetStats();
+		uint32_t wakeups = (power.wakeups - lastPower.wakeups) * 10 * configTICK_RATE_HZ / reportPeriod;   // tenths per second
+		uint32_t asleep = (uint64_t)(power.asleep - lastPower.asleep) * 1000 / (Periph::Rtc::frequency * reportPeriod / configTICK_RATE_HZ);
+		lastPower = power;
+		Write("power wake/s=%lu.%lu stops=%lu asleep=%lu.%lu%%\r\n", (unsigned long)(wakeups / 10), (unsigned long)(wakeups % 10),
+			(unsigned long)power.stops, (unsigned long)(asleep / 10), (unsigned long)(asleep % 10));
+#endif // LOW_POWER
+
+#ifdef WAVETABLE
+		Synth::Stats synth = Synth::GetStats();
+		uint32_t blocks = synth.blocks - lastSynth.blocks;
+		if (blocks) {
+			// tenths of a cycle per sample, and of a percent of the CPU at the sample rate
+			uint32_t perSample = (synth.cycles - lastSynth.cycles) * 10 / ((uint64_t)blocks * Synth::blockSize);
+			uint32_t share = (uint64_t)perSample * Periph::PwmDac::rate * 100 / SYSCLK;
+			Write("synth cyc/sample=%lu.%lu worst=%lu cpu=%lu.%lu%%\r\n", (unsigned long)(perSample / 10), (unsigned long)(perSample % 10),
+				(unsigned long)(synth.worst / Synth::blockSize), (unsigned long)(share / 10), (unsigned long)(share % 10));
+		}
+		lastSynth = synth;
+#endif // WAVETABLE
+
+		for (UBaseType_t i = 0; i < count; i++) {
+			const TaskStatus_t &task = status[i];
+			uint32_t busy = task.ulRunTimeCounter;
+			for (const Sample &sample : previous) {
+				if (sample.handle == task.xHandle) {
+					busy -= sample.runTime;
+					break;
+				}
+			}
+			uint32_t permille = elapsed ? (uint32_t)((uint64_t)busy * 1000 / elapsed) : 0;
+			Write("%-12s hwm=%4u cpu=%3lu.%lu%% sw=%lu\r\n", task.pcTaskName, (unsigned)task.usStackHighWaterMark,
+				(unsigned long)(permille / 10), (unsigned long)(permille % 10), (unsigned long)uxTaskGetTaskNumber(task.xHandle));
+		}
+
+		for (UBaseType_t i = 0; i < previous.size(); i++)
+			previous[i] = (i < count) ? Sample{ status[i].xHandle, status[i].ulRunTimeCounter } : Sample{ NULL, 0 };
+	}
+
+	// Send() copies 'line' into the TX ring, only a full ring makes us wait
+	template<typename... Args>
+	static void Write(const char *format, Args... args) {
+		int size = snprintf(line.data(), line.size(), format, args...);
+		if (size > 0) {
+			while (!usart->Send(line.data(), (uint16_t)std::min<int>(size, line.size() - 1)))
+				vTaskDelay(1);
+		}
+	}
+
+	static inline Periph::USART_1 *usart = NULL;
+	static inline Rtos::Task<256> reporter;     // snprintf wants more than the minimal stack
+	static inline std::array<TaskStatus_t, maxTasks> status;
+	static inline std::array<Sample, maxTasks> previous;
+	static inline std::array<char, 64> line;
+	static inline uint32_t lastTotal = 0;
+#ifdef LOW_POWER
+	static inline Power::Stats lastPower = {};
+#endif // LOW_POWER
+#ifdef WAVETABLE
+	static inline Synth::Stats lastSynth = {};
+#endif // WAVETABLE
+
+public:
+	static constexpr uint32_t staticRam = sizeof(reporter) + sizeof(status) + sizeof(previous) + sizeof(line);
+};
+
+extern "C" void vConfigureTimerForRunTimeStats(void) {
+	Periph::Timebase::Init();
+}
+
+extern "C" unsigned long ulGetRunTimeCounterValue(void) {
+	return Periph::Timebase::Now();
+}
+#endif // TASK_STATS
@@ -0,0 +1,217 @@
+#pragma once
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include "utils.hpp"
+
+// Binary telemetry on USART1, shared with tools/teldecode. A frame is
+//   version, type, sequence (u16), payload, CRC-16 (u16) over all before it,
+// little-endian, COBS-encoded and wrapped in 0x00 on both sides, so the
+// text that shares the line (TaskStats, CSV exports, command replies) never
+// runs into a frame. The sequence counts every frame the firmware built,
+// sent or dropped, so the host can see what it missed.
+namespace Telemetry
+{
+	constexpr uint8_t version = 2;
+	constexpr uint8_t headerSize = 4;
+	constexpr uint8_t crcSize = 2;
+	constexpr uint8_t maxPayload = 64;
+	constexpr uint16_t maxFrame = headerSize + maxPayload + crcSize;
+	constexpr uint16_t maxEncoded = maxFrame + maxFrame / 254 + 1 + 2;   // COBS overhead and both delimiters
+
+	// Payload fields in order; varint is LEB128, signed is zigzag + varint.
+	enum Type : uint8_t {
+		Boot = 1,         // u8 seats, u32 core clock Hz
+		TurnSwitch = 2,   // u32 core cycles from the button press to the next turn running
+		Keyframe = 6,     // u8 seats, then as Delta; a full state too big for one frame takes several
+		Delta = 7,        // field mask (a varint, as long as the fields need), then a signed value for each set bit, lowest first
+	};
+
+	// Game state fields of Keyframe and Delta: these, then a score and a
+	// bank in ms for each seat. Masks are bit sets of seats. Remaining is
+	// only sent as the clock starts or stops: while Flags has Running set,
+	// the receiver counts it down.
+	enum Field : uint8_t { Seated, InPlay, Player, TurnTime, Increment, Mode, Flags, Remaining, SeatFields };
+	enum Flag : uint8_t { CountScores = 1 << 0, Reversed = 1 << 1, Running = 1 << 2 };
+	constexpr uint8_t FieldCount(uint8_t seats) { return SeatFields + 2 * seats; }
+	constexpr uint8_t ScoreField(uint8_t seat) { return SeatFields + seat; }
+	constexpr uint8_t BankField(uint8_t seats, uint8_t seat) { return SeatFields + seats + seat; }
+	constexpr uint8_t maxFields = FieldCount(64);   // a GameEngine seats 64 at most
+	constexpr uint8_t maxVarint = 10;
+
+	// A frame under construction; Put*() past maxPayload marks it invalid.
+	class Frame {
+	public:
+		inline explicit Frame(Type type) { bytes[0] = version; bytes[1] = type; }
+
+		inline Frame &Put8(uint8_t value) {
+			if (size < headerSize + maxPayload)
+				bytes[size++] = value;
+			else
+				overflow = true;
+			return *this;
+		}
+
+		inline Frame &Put16(uint16_t value) { return Put8(value).Put8(value >> 8); }
+		inline Frame &Put32(uint32_t value) { return Put16(value).Put16(value >> 16); }
+
+		inline Frame &PutVarint(uint64_t value) {
+			while (value >= 0x80) {
+				Put8((value & 0x7F) | 0x80);
+				value >>= 7;
+			}
+			return Put8(value);
+		}
+
+		inline Frame &PutSigned(int64_t value) { return PutVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63)); }
+		
+		// a bit set as a varint, bit 0 first: up to 64 bits the bytes are
+		// PutVarint()'s, wider sets just take more of them
+		template<size_t N>
+		inline Frame &PutVarint(const std::bitset<N> &bits) {
+			size_t top = N;
+			while (top && !bits[top - 1])
+				top--;
+			size_t bit = 0;
+			do {
+				uint8_t byte = 0;
+				for (uint8_t i = 0; i < 7 && bit + i < N; i++)
+					byte |= bits[bit + i] << i;
+				bit += 7;
+				Put8(bit < top ? byte | 0x80 : byte);
+			} while (bit < top);
+			return *this;
+		}
+		
+		inline uint8_t Room() const { return headerSize + maxPayload - size; }
+
+		// seals the frame under 'sequence' into 'out'; 0 if the payload overflowed
+		inline uint16_t Encode(uint16_t sequence, std::array<uint8_t, maxEncoded> &out) {
+			if (overflow)
+				return 0;
+			bytes[2] = sequence;
+			bytes[3] = sequence >> 8;
+			uint16_t crc = utils::crc16(bytes.data(), size);
+			bytes[size] = crc;
+			bytes[size + 1] = crc >> 8;
+			out[0] = 0;
+			uint16_t encoded = 1 + CobsEncode(bytes.data(), size + crcSize, out.data() + 1);
+			out[encoded++] = 0;
+			return encoded;
+		}
+
+	private:
+		static inline uint16_t CobsEncode(const uint8_t *in, uint16_t length, uint8_t *out) {
+			uint16_t code = 0, write = 1;
+			uint8_t run = 1;
+			for (uint16_t i = 0; i < length; i++) {
+				if (in[i]) {
+					out[write++] = in[i];
+					run++;
+				}
+				if (!in[i] || run == 0xFF) {
+					out[code] = run;
+					code = write++;
+					run = 1;
+				}
+			}
+			out[code] = run;
+			return write;
+		}
+
+		std::array<uint8_t, maxFrame> bytes;
+		uint16_t size = headerSize;
+		bool overflow = false;
+	};
+
+	// decodes one COBS block (the bytes between two 0x00) in place; 0 if malformed
+	inline uint16_t CobsDecode(uint8_t *data, uint16_t length) {
+		uint16_t read = 0, write = 0;
+		while (read < length) {
+			uint8_t code = data[read++];
+			if (!code || read + code - 1 > length)
+				return 0;
+			for (uint8_t i = 1; i < code; i++)
+				data[write++] = data[read++];
+			if (code < 0xFF && read < length)
+				data[write++] = 0;
+		}
+		return write;
+	}
+
+	// Reads payload fields back; any read past the end sets 'overrun'.
+	class Reader {
+	public:
+		inline Reader(const uint8_t *data, uint16_t length) : data(data), length(length) {}
+
+		inline uint8_t Get8() {
+			if (position < length)
+				return data[position++];
+			overrun = true;
+			return 0;
+		}
+
+		inline uint16_t Get16() { uint16_t low = Get8(); return low | Get8() << 8; }
+		inline uint32_t Get32() { uint32_t low = Get16(); return low | (uint32_t)Get16() << 16; }
+
+		inline uint64_t GetVarint() {
+			uint64_t value = 0;
+			for (uint8_t shift = 0; shift < 7 * maxVarint; shift += 7) {
+				uint8_t byte = Get8();
+				value |= (uint64_t)(byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+					return value;
+			}
+			overrun = true;
+			return value;
+		}
+
+		inline int64_t GetSigned() { uint64_t value = GetVarint(); return (int64_t)(value >> 1) ^ -(int64_t)(value & 1); }
+		
+		// a bit set written by PutVarint(); a bit beyond N is an overrun
+		template<size_t N>
+		inline std::bitset<N> GetBits() {
+			std::bitset<N> bits;
+			for (size_t shift = 0; ; shift += 7) {
+				uint8_t byte = Get8();
+				for (uint8_t i = 0; i < 7; i++) {
+					if (!(byte >> i & 1))
+						continue;
+					if (shift + i < N)
+						bits.set(shift + i);
+					else
+						overrun = true;
+				}
+				if (!(byte & 0x80) || overrun)
+					return bits;
+			}
+		}
+
+		inline bool Done() const { return position == length; }
+
+		bool overrun = false;
+
+	private:
+		const uint8_t *data;
+		uint16_t length;
+		uint16_t position = 0;
+	};
+
+	// Checks a decoded frame; the payload is then data + headerSize, 'payloadSize' long.
+	struct Header {
+		uint8_t version;
+		Type type;
+		uint16_t sequence;
+		uint16_t payloadSize;
+	};
+
+	inline bool Parse(const uint8_t *data, uint16_t length, Header &header) {
+		if (length < headerSize + crcSize)
+			return false;
+		uint16_t crc = data[length - 2] | data[length - 1] << 8;
+		if (utils::crc16(data, length - crcSize) != crc)
+			return false;
+		header = Header{ data[0], Type(data[1]), (uint16_t)(data[2] | data[3] << 8), (uint16_t)(length - headerSize - crcSize) };
+		return true;
+	}
+}
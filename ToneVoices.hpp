@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <periph.hpp>
+#include <Tones.hpp>
+
+// The voices as square waves on compare channels of TIM2, TIM3 and TIM4,
+// one pin each, to be mixed through resistors into the amplifier. A
+// voice's pin toggles on every compare match and its interrupt sets the
+// next one, so a sounding voice costs an interrupt per edge; the
+// sequencer's work per event stays a few register writes.
+class ToneVoices {
+public:
+	static constexpr uint8_t count = Tones::channels;
+	static constexpr uint8_t maxTimers = 3;
+	static inline std::array <Periph::ToneTimer, maxTimers> timers = {
+		Periph::ToneTimer(*TIM2, TIM2_IRQn, Tones::clock),
+		Periph::ToneTimer(*TIM3, TIM3_IRQn, Tones::clock),
+		Periph::ToneTimer(*TIM4, TIM4_IRQn, Tones::clock)
+	};
+	static_assert(SYSCLK % Tones::clock == 0, "the voice timers need a whole prescaler");
+	
+	// voice n plays on compare channel outputs[n] (0 is CH1), pins in Init()
+	struct Output {
+		uint8_t timer;
+		uint8_t channel;
+	};
+	static constexpr std::array<Output, count> outputs = { {
+		{ 0, 1 },   // TIM2_CH2 PA1
+		{ 1, 1 },   // TIM3_CH2 PA7
+		{ 1, 0 },   // TIM3_CH1 PA6
+		{ 1, 2 },   // TIM3_CH3 PB0
+		{ 1, 3 },   // TIM3_CH4 PB1
+		{ 2, 0 },   // TIM4_CH1 PB6
+		{ 2, 1 },   // TIM4_CH2 PB7
+		{ 2, 2 }    // TIM4_CH3 PB8
+	} };
+	
+	static inline void Init() {
+		using Periph::OutPin;
+		OutPin(*GPIOA, 1, OutPin::AFpushpull, OutPin::MHz50);
+		OutPin(*GPIOA, 7, OutPin::AFpushpull, OutPin::MHz50);
+		OutPin(*GPIOA, 6, OutPin::AFpushpull, OutPin::MHz50);
+		OutPin(*GPIOB, 0, OutPin::AFpushpull, OutPin::MHz50);
+		OutPin(*GPIOB, 1, OutPin::AFpushpull, OutPin::MHz50);
+		OutPin(*GPIOB, 6, OutPin::AFpushpull, OutPin::MHz50);
+		OutPin(*GPIOB, 7, OutPin::AFpushpull, OutPin::MHz50);
+		OutPin(*GPIOB, 8, OutPin::AFpushpull, OutPin::MHz50);
+		Silence();
+	}
+	
+	// the timers run all the time, a silent voice costs nothing
+	static inline void Start() {}
+	static inline void Stop() { Silence(); }
+	
+	// A sounding voice keeps its phase, the new period starts with its next
+	// edge; a silent one starts low and toggles a moment later. Square waves
+	// have the one timbre, the instrument is ignored.
+	static inline void Set(uint8_t index, const Tones::Event &event) {
+		Voice &voice = voices[index];
+		auto &tones = timers[outputs[index].timer];
+		uint8_t channel = outputs[index].channel;
+		if (!event.duty || !event.period) {
+			tones.Mute(channel);
+			voice.sounding = false;
+			return;
+		}
+		tones.Hold(channel);
+		Split(voice, event.period, event.duty);
+		if (voice.sounding) {
+			tones.Resume(channel);
+			return;
+		}
+		uint16_t first = tones.Now() + minLead;
+		voice.edge = (uint32_t)first << Tones::periodShift;
+		voice.level = false;
+		voice.sounding = true;
+		tones.Start(channel, first);
+	}
+	
+	// a sounding voice's level, from its next edge; cheap enough for every
+	// envelope step
+	static inline void Level(uint8_t index, uint8_t level) {
+		Voice &voice = voices[index];
+		if (!voice.sounding)
+			return;
+		auto &tones = timers[outputs[index].timer];
+		uint8_t channel = outputs[index].channel;
+		tones.Hold(channel);
+		Split(voice, voice.high + voice.low, level);
+		tones.Resume(channel);
+	}
+	
+	static inline void Silence() {
+		for (uint8_t voice = 0; voice < count; voice++)
+			Set(voice, Tones::Event{});
+	}
+	
+	// TIM2, TIM3 and TIM4 ('timer' 0 to 2): the next edge of each voice that
+	// just toggled. Its half periods carry their fraction from edge to edge;
+	// an edge the handler came too late for is moved to just ahead.
+	static void HandleInterrupt(uint8_t timer) {
+		auto &tones = timers[timer];
+		uint32_t matched = tones.TakeMatches();
+		for (uint8_t channel = 0; matched; channel++, matched >>= 1) {
+			if (!(matched & 1))
+				continue;
+			Voice &voice = voices[voiceAt[timer][channel]];
+			voice.level = !voice.level;
+			voice.edge += voice.level ? voice.high : voice.low;
+			uint16_t at = voice.edge >> Tones::periodShift;
+			uint16_t now = tones.Now();
+			if ((int16_t)(at - now) < minLead) {
+				at = now + minLead;
+				voice.edge = (uint32_t)at << Tones::periodShift;
+			}
+			tones.Compare(channel) = at;
+		}
+	}
+	
+private:
+	// voice index of each timer's compare channels, none for unused ones
+	static constexpr uint8_t none = 0xFF;
+	static constexpr auto voiceAt = [] {
+		std::array<std::array<uint8_t, Periph::ToneTimer::channels>, maxTimers> table = {};
+		for (auto &channels : table) {
+			for (auto &voice : channels)
+				voice = none;
+		}
+		for (uint8_t voice = 0; voice < count; voice++)
+			table[outputs[voice].timer][outputs[voice].channel] = voice;
+		return table;
+	}();
+	
+	static constexpr int16_t minLead = 8;    // counts from now to a new compare, covers the handler's latency
+	static constexpr uint32_t minHalf = 16;  // counts; shortest high or low half period
+	
+	struct Voice {
+		uint32_t edge;   // time of the pending edge, in 1/256 counts
+		uint32_t high;   // half period lengths, in 1/256 counts
+		uint32_t low;
+		bool level;      // pin level since the last edge
+		bool sounding;
+	};
+	static inline std::array<Voice, count> voices = {};
+	
+	// A square's fundamental goes with sin(pi * high / period), so the pulse
+	// for a level narrows along the arcsine; 128 and up is 50 %. In 1/256
+	// of the period.
+	static constexpr auto pulses = [] {
+		std::array<uint8_t, 256> table = {};
+		for (int level = 0; level < 256; level++) {
+			double wanted = level < 128 ? level / 128.0 : 1;
+			uint8_t pulse = 0;
+			while (pulse < 128 && Tones::Sine((pulse + 0.5) / 512) < wanted)
+				pulse++;
+			table[level] = pulse;
+		}
+		return table;
+	}();
+	
+	static inline void Split(Voice &voice, uint32_t period, uint8_t level) {
+		constexpr uint32_t shortest = minHalf << Tones::periodShift;
+		uint32_t high = std::clamp<uint32_t>((uint64_t)period * pulses[level] >> 8, shortest, period - shortest);
+		voice.high = high;
+		voice.low = period - high;
+	}
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "Notes.hpp"
+
+// Compiled tracks: Playtune resolved ahead of time (tools/playtunec) into
+// per-voice periods, with the voices already allocated, so MusicPlayer
+// only hands them to the outputs. Host-safe, shared with tools/playtunec.
+namespace Tones
+{
+	constexpr uint8_t tonegens = 16;   // Playtune tone generators
+	constexpr uint8_t channels = 8;    // voices, see MusicPlayer
+	constexpr uint32_t clock = 1000000;   // counts per second of the voice timers
+	constexpr uint8_t periodShift = 8;    // periods are in 1/256 counts
+
+	enum Channel : uint8_t {
+		wait = 0xFE,         // no output changes, only carries a delay
+		endOfTrack = 0xFF,
+	};
+
+	// 'delay' ms after the previous event, voice 'channel' (or a Channel
+	// value) plays a note 'period' long at level 'duty', 128 the full level
+	// of a square wave (50 % high) and 0 silence. WAVETABLE builds play wave
+	// 'instrument' with duty/256 as its amplitude.
+	struct Event {
+		uint16_t delay;
+		uint8_t channel;
+		uint8_t duty;
+		uint32_t period : 24;
+		uint32_t instrument : 8;
+	};
+
+	constexpr uint8_t defaultDuty = 128;   // and the level of Playtune's loudest note
+
+	enum Wave : uint8_t { square, triangle, sine, sawtooth, waves };
+
+	// Playtune instruments are General MIDI programs, a wave for each family
+	// of eight; tracks without instrument changes keep the square
+	constexpr Wave Instrument(uint8_t program) {
+		constexpr Wave families[16] = {
+			triangle, sine, square, sawtooth,     // piano, chromatic percussion, organ, guitar
+			triangle, sawtooth, sawtooth, square, // bass, strings, ensemble, brass
+			square, sine, square, triangle,       // reed, pipe, synth lead, synth pad
+			sawtooth, triangle, sine, square      // synth effects, ethnic, percussive, sound effects
+		};
+		return families[(program & 0x7F) / 8];
+	}
+
+	constexpr uint8_t notes = sizeof(pitches) / sizeof(pitches[0]);
+	constexpr uint8_t noteA4 = 58;   // pitches[noteA4] == NOTE_A4
+	constexpr uint8_t lastNamedNote = 100;   // NOTE_DS8, the entries after it are not notes
+	static_assert(pitches[noteA4] == NOTE_A4 && pitches[lastNamedNote] == NOTE_DS8, "pitches[] changed");
+
+	// Equal-tempered frequency of the note pitches[note] names, A4 = 440 Hz
+	// (pitches[] holds it rounded to whole Hz); other entries as they are.
+	constexpr double Ideal(uint8_t note) {
+		if (note == 0 || note > lastNamedNote)
+			return note < notes ? pitches[note] : 0;
+		constexpr double semitone = 1.0594630943592953;   // 2^(1/12)
+		double frequency = 440;
+		for (uint8_t i = note; i < noteA4; i++)
+			frequency /= semitone;
+		for (uint8_t i = noteA4; i < note; i++)
+			frequency *= semitone;
+		return frequency;
+	}
+
+	// sin(2 pi turns) for the tables built at compile time, a Taylor series
+	constexpr double Sine(double turns) {
+		double x = 2 * 3.14159265358979 * (turns - (int)turns < 0.5 ? turns - (int)turns : turns - (int)turns - 1);
+		double term = x, sum = x;
+		for (int n = 1; n < 12; n++) {
+			term *= -x * x / ((2 * n) * (2 * n + 1));
+			sum += term;
+		}
+		return sum;
+	}
+
+	// 'frequency' as a period in 1/256 counts; the fraction carries from
+	// edge to edge, so the average pitch is exact to well under a cent
+	constexpr uint32_t Period(double frequency) {
+		return frequency > 0 ? (uint32_t)(clock * (double)(1 << periodShift) / frequency + 0.5) : 0;
+	}
+
+	// every pitches[] entry; constexpr, so a table costs no startup time
+	constexpr std::array<uint32_t, notes> Periods() {
+		std::array<uint32_t, notes> table = {};
+		for (uint8_t note = 0; note < notes; note++)
+			table[note] = Period(Ideal(note));
+		return table;
+	}
+
+	// each half of a period must fit the 16-bit counter, and so Event::period
+	static_assert(Periods()[1] < 0x10000 << periodShift, "lowest note too long for the voice timers");
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+
+// Turn time measured from timestamps of a free-running clock instead of
+// counting down ticks, so pausing, resuming and switching turns lose nothing.
+// Clock provides Now() (wrapping uint32_t counts) and 'frequency'.
+template<typename Clock>
+class TurnClock {
+public:
+	inline void Reset(int32_t budgetMs) {
+		budget = budgetMs;
+		used = 0;
+		running = false;
+	}
+
+	// 'lateMs' backdates the start to when the triggering event really happened
+	inline void Start(int32_t budgetMs, uint32_t lateMs = 0) {
+		Reset(budgetMs);
+		since = Clock::Now() - ToCounts(lateMs);
+		running = true;
+	}
+
+	inline void Pause(uint32_t lateMs = 0) {
+		if (running) {
+			uint32_t stretch = Clock::Now() - since;
+			uint32_t late = ToCounts(lateMs);
+			used += stretch > late ? stretch - late : 0;
+			running = false;
+		}
+	}
+
+	inline void Resume() {
+		if (!running) {
+			since = Clock::Now();
+			running = true;
+		}
+	}
+
+	inline bool Running() const { return running; }
+	
+	// clock count the current running stretch began at: new on every start and resume
+	inline uint32_t StartedAt() const { return since; }
+
+	inline uint32_t ElapsedMs() const {
+		uint32_t counts = used + (running ? Clock::Now() - since : 0);
+		return (uint64_t)counts * 1000 / Clock::frequency;
+	}
+
+	// negative once the turn runs into overtime
+	inline int32_t RemainingMs() const { return budget - (int32_t)ElapsedMs(); }
+
+private:
+	static inline uint32_t ToCounts(uint32_t ms) { return (uint64_t)ms * Clock::frequency / 1000; }
+
+	int32_t budget = 0;
+	uint32_t used = 0;    // clock counts from finished running stretches
+	uint32_t since = 0;   // start of the current stretch
+	bool running = false;
+};
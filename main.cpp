@@ -1,13 +1,11 @@
 #include <main.hpp>
 
-static std::array<char, 8> buffer = { 'B', 'a', 'a', 'a', 'a', 'a', '\r', '\n' };
 constexpr uint32_t baudrate = 115200;
 
 using namespace Periph;
-using namespace EmbeddedResources;
 using namespace std;
 
-static USART_1 usart = USART_1(OutPin(*GPIOA, 9, OutPin::AFopendrain, OutPin::MHz50), InPin(*GPIOA, 10, InPin::floating), baudrate, buffer);
+static USART_1 usart = USART_1(OutPin(*GPIOA, 9, OutPin::AFopendrain, OutPin::MHz50), InPin(*GPIOA, 10, InPin::floating), baudrate);
 static Led led1(OutPin(*GPIOA, 3, OutPin::pushpull, OutPin::MHz10));
 static Led led2(OutPin(*GPIOA, 0, OutPin::pushpull, OutPin::MHz10));
 static Button bigButton(InPin(*GPIOA, 2, InPin::pulldown), Button::NO);
@@ -15,19 +13,46 @@ static Button plusButton(InPin(*GPIOB, 15, InPin::pulldown), Button::NO);
 static Button minusButton(InPin(*GPIOB, 12, InPin::pulldown), Button::NO);
 
 static GameEngine ge = GameEngine();
+using GameJournal = Journal<GameEngine>;
+
+// the widest table the template takes still has to journal and publish
+using WidestGameEngine = BasicGameEngine<64, Periph::Rtc, 5, 3600>;
+static_assert(sizeof(Journal<WidestGameEngine>) && sizeof(Publisher<WidestGameEngine>), "64 seats must build");
 
 static MusicPlayer mp = MusicPlayer();
-static array<pair<uint8_t*, uint32_t>, 6> tracks =  {{ 
-	{ (uint8_t*)Resources_imperial_march_bin.data(), (uint32_t)Resources_imperial_march_bin.size() },
-	{ (uint8_t*)Resources_main_theme_bin.data(), (uint32_t)Resources_main_theme_bin.size() },
-	{ (uint8_t*)Resources_boulevard_of_broken_dreams_bin.data(), (uint32_t)Resources_boulevard_of_broken_dreams_bin.size() },
-	{ (uint8_t*)Resources_gravity_falls_soundtrack_bin.data(), (uint32_t)Resources_gravity_falls_soundtrack_bin.size() },
-	{ (uint8_t*)Resources_super_mario_bin.data(), (uint32_t)Resources_super_mario_bin.size() },
-	{ (uint8_t*)Resources_tetris_bin.data(), (uint32_t)Resources_tetris_bin.size() }
+static array<MusicPlayer::Track, 6> tracks =  {{ 
+	{ CompiledTracks::imperial_march, (uint32_t)size(CompiledTracks::imperial_march) },
+	{ CompiledTracks::main_theme, (uint32_t)size(CompiledTracks::main_theme) },
+	{ CompiledTracks::boulevard_of_broken_dreams, (uint32_t)size(CompiledTracks::boulevard_of_broken_dreams) },
+	{ CompiledTracks::gravity_falls_soundtrack, (uint32_t)size(CompiledTracks::gravity_falls_soundtrack) },
+	{ CompiledTracks::super_mario, (uint32_t)size(CompiledTracks::super_mario) },
+	{ CompiledTracks::tetris, (uint32_t)size(CompiledTracks::tetris) }
 }};
 
-static TimerHandle_t secondsTimerHandle = NULL;
-static TaskHandle_t xMusicHandle = NULL;
+static Rtos::Task<> ledTask;
+// The game task also builds telemetry, parses commands, appends to the
+// journal and snprintf()s the CSV export; check its TASK_STATS hwm.
+static Rtos::Task<384> gameTask;
+
+#if defined(STATIC_MEMORY) && !defined(configHOST_STACKS)
+static_assert(Rtos::kernelRam + Input::staticRam + sizeof(ledTask) + sizeof(gameTask) <= rtosRamBudget,
+	"kernel objects exceed rtosRamBudget");   // TASK_STATS adds TaskStats::staticRam on top, outside the budget
+#endif // STATIC_MEMORY
+
+static CommandReader<USART_1> commands;
+#ifdef DEBUG
+static Publisher<GameEngine> publisher;
+#endif // DEBUG
+static uint8_t pauseChord = 0;
+
+static bool turnPaused = false;
+static bool resumeGame = false;   // restored from the journal at boot
+static uint32_t eventAgeMs = 0;   // debounce and queueing delay of the event being handled
+static int32_t scoreDelta = 0;
+#ifdef DEBUG
+static uint32_t turnSwitchStart = 0;
+static bool turnSwitchStamped = false;   // a big-button handoff is being timed
+#endif // DEBUG
 
 void MCO_out() {
 	OutPin(*GPIOA, 8, OutPin::AFopendrain, OutPin::MHz50);
@@ -44,11 +69,36 @@ int main() {
 
 void logic()
 {
+	// holding the big button through reset starts a new game instead
+	GameEngine::State saved;
+	if (!bigButton.Pressed() && GameJournal::Load(saved))
+		resumeGame = GameEngine::Restore(saved);
+	
 	led1.SetHigh();
-	usart.Send();
-	xTaskCreate(vTaskLed, "LED", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-//	xTaskCreate(vTaskStateMachine, "FSM", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-	xTaskCreate(vTaskPlayerSetup, "Player", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
+	SendTelemetry(Telemetry::Frame(Telemetry::Boot).Put8(GameEngine::maxPlayers).Put32(SYSCLK));
+	Input::Register(bigButton);
+	Input::Register(plusButton);
+	Input::Register(minusButton);
+	pauseChord = Input::AddChord({ &plusButton, &minusButton });
+	Input::Start();
+#if defined(DEBUG) || defined(TASK_STATS)
+	CycleCounter::Init();   // TASK_STATS times the synth's mixing
+#endif
+#ifdef TASK_STATS
+	TaskStats::Start(usart);
+#endif // TASK_STATS
+	
+	Rtc::Init();   // turn clock
+	
+#ifdef LOW_POWER
+	led1.SetLow();   // no heartbeat, it would wake the CPU every second
+#else
+	ledTask.Create(vTaskLed, "LED", 1);
+#endif // LOW_POWER
+#if configUSE_TICKLESS_IDLE == 2
+	Power::Init();
+#endif
+	gameTask.Create(vTaskGame, "Game", 1);
 	vTaskStartScheduler();
 	
 	while(1) {
@@ -56,209 +106,366 @@ void logic()
 	};
 }
 
-void vTaskPlayerSetup(void *parameter)
-{
+// One long-lived task runs the whole game; states only switch on events,
+// so a turn handoff costs no task creation or heap traffic.
+void vTaskGame(void *) {
+	GameState state = resumeGame ? EnterState(StateTurn) : StatePlayerSetup;
+	Report(true);
+	ButtonEvent event;
 	while (1)
 	{
-		if (plusButton.PressedDebounced())
-		{
-			GameEngine::AddPlayer();
-		}
-		if (minusButton.PressedDebounced())
-		{
-			GameEngine::RemovePlayer();
-		}
-		
+		TickType_t wait = state == StateTurn ? TurnWait() : portMAX_DELAY;
+		TickType_t timeout = wait;
 #ifdef DEBUG
-		for (auto i = 0; i < GameEngine::maxPlayers; i++)
-			buffer[i] = GameEngine::playerScore[i];
-		usart.Send();
+		// keyframes fall due in every state, so a late receiver still syncs
+		timeout = std::min(wait, publisher.NextDue(xTaskGetTickCount()));
 #endif // DEBUG
+		bool received = Input::Receive(event, timeout);
+		eventAgeMs = received ? (xTaskGetTickCount() - event.timestamp) * 1000 / pdMS_TO_TICKS(1000) : 0;
 		
+		if (received && event.type == ButtonEvent::Frame) {
+			RunCommands(state);
+			Report(true);
+			continue;
+		}
+		if (!received && timeout != wait) {   // only a keyframe fell due
+			Report(false);
+			continue;
+		}
 		
-		if (GameEngine::activePlayers > 1 && bigButton.PressedDebounced())
+		GameState next = state;
+		switch (state)
+		{
+		case StatePlayerSetup:
+			next = PlayerSetup(event);
+			break;
+		case StateTimerSetup:
+			next = TimerSetup(event);
 			break;
+		case StateConfig:
+			next = Config(event);
+			break;
+		case StateTurn:
+			next = received ? Turn(event) : TurnTick();
+			break;
+		case StateTurnEnd:
+			next = TurnEnd(event);
+			break;
+		}
 		
-		vTaskDelay(5);
+		if (next != state) {
+			LeaveState(state);
+			state = EnterState(next);
+		}
+		Report(received);
 	}
-	xTaskCreate(vTaskTimerSetup, "TaskTimerSetup", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-	vTaskDelete(NULL);
 }
 
-void vTaskTimerSetup(void *parameter) {
-	while (1)
+// Publishes the snapshot after an event; a timeout only ticks the turn
+// clock, which readers work out from their copy. DEBUG builds then send the
+// fields that differ from the last telemetry, and a keyframe when one is due.
+void Report(bool changed) {
+	if (changed)
+		GameEngine::Publish();
+#ifdef DEBUG
+	publisher.Update(GameEngine::Read(), xTaskGetTickCount(), SendTelemetry);
+#endif // DEBUG
+}
+
+GameState EnterState(GameState state) {
+	switch (state)
 	{
-		if (plusButton.PressedDebounced())
-		{
-			GameEngine::IncrementTurnTime();
-		}
-		else if (minusButton.PressedDebounced())
-		{
-			GameEngine::DecrementTurnTime();
-		}
-		else vTaskDelay(10);
-		
-		if (bigButton.PressedDebounced()) {
-			break;
-		}
-		vTaskDelay(10);
-		
+	case StateTurn:
+		turnPaused = false;
+		GameEngine::StartTurnTimer(eventAgeMs);
 #ifdef DEBUG
-		auto [minutes, seconds] = GameEngine::GetTimerValue();
-		buffer[0] = minutes;
-		buffer[1] = seconds;
-		usart.Send();
+		// not after the menus or a resume, those entries have no press to time
+		if (turnSwitchStamped)
+			SendTelemetry(Telemetry::Frame(Telemetry::TurnSwitch).Put32(CycleCounter::Now() - turnSwitchStart));
+		turnSwitchStamped = false;
 #endif // DEBUG
-		
+		GameJournal::Append(GameEngine::Capture());   // after the handoff is visible
+		break;
+	case StateTurnEnd:
+		scoreDelta = 0;
+		if (!GameEngine::countScores) {
+			GameEngine::NextPlayer();
+			return EnterState(StateTurn);
+		}
+		break;
+	default:
+		break;
 	}
+	return state;
+}
 
-	secondsTimerHandle = xTimerCreate("SecondsTimer",
-		pdMS_TO_TICKS(1000), //counts 1 sec
-		pdTRUE, //auto-reload
-		NULL, //not assigning ID 
-		vTimerCallback // function to call after timer expires
-		); 
+void LeaveState(GameState state) {
+	switch (state)
+	{
+	case StateTurn:
+		GameEngine::SuspendTurn();
+		mp.Stop();
+		break;
+	default:
+		break;
+	}
+}
 
-	xTaskCreate(vTaskConfig, "Config", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-	vTaskDelete(NULL);
+GameState PlayerSetup(const ButtonEvent &event) {
+	if (event.type != ButtonEvent::Press)
+		return StatePlayerSetup;
+	
+	if (event.button == plusButton.Id())
+	{
+		GameEngine::AddPlayer();
+	}
+	else if (event.button == minusButton.Id())
+	{
+		GameEngine::RemovePlayer();
+	}
+	else if (GameEngine::activePlayers > 1 && event.button == bigButton.Id())
+		return StateTimerSetup;
+	
+	return StatePlayerSetup;
 }
 
-void vTaskConfig(void *parameter) {
-	while (1)
+GameState TimerSetup(const ButtonEvent &event) {
+	if (event.type != ButtonEvent::Press && event.type != ButtonEvent::Repeat)
+		return StateTimerSetup;
+	
+	if (event.button == plusButton.Id())
 	{
-		if (plusButton.PressedDebounced())
-			GameEngine::countScores = !GameEngine::countScores;
-		if (minusButton.PressedDebounced())
-		// show round number or change the way it counts
-			GameEngine::countScores = !GameEngine::countScores;
-		if (bigButton.PressedDebounced()) {
-			break;
-		}
-		vTaskDelay(10);
+		GameEngine::IncrementTurnTime();
+	}
+	else if (event.button == minusButton.Id())
+	{
+		GameEngine::DecrementTurnTime();
+	}
+	else if (event.button == bigButton.Id() && event.type == ButtonEvent::Press) {
+		return StateConfig;
 	}
-	xTaskCreate(vTaskTurn, "TaskTurn", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-	vTaskDelete(NULL);
+	
+	return StateTimerSetup;
 }
 
-void vTaskTurn(void *parameter) {
-	xTimerReset(secondsTimerHandle, 0);
+GameState Config(const ButtonEvent &event) {
+	if (event.type == ButtonEvent::Chord && event.button == pauseChord) {
+		ExportHistory();
+		return StateConfig;
+	}
+	if (event.type != ButtonEvent::Press)
+		return StateConfig;
 	
-	TickType_t xLastWakeTime;
-	xLastWakeTime = xTaskGetTickCount();
+	if (event.button == plusButton.Id())
+		GameEngine::countScores = !GameEngine::countScores;
+	else if (event.button == minusButton.Id())
+		GameEngine::NextClockMode();
+	else if (event.button == bigButton.Id()) {
+		GameEngine::StartGame();
+		return StateTurn;
+	}
+	return StateConfig;
+}
+
+// Waits only while the TX ring is full; the whole dump is ~3 ms a turn at 115200.
+void ExportHistory() {
+	auto send = [](const char *data, uint16_t size) {
+		while (!usart.Send(data, size))
+			vTaskDelay(1);
+	};
+	GameHistory::Export(send);
+	GameEngine::playerStats.Export(send);
+}
+
+// Remote control over USART1, one command per line, answered with "ok" or "err":
+//   add | remove            seat or unseat a player (player setup only)
+//   time <seconds>          turn time, and the banks before the game starts
+//   score <player> <delta>  adjust any seated player's score
+//   skip | reverse          pass over the next player, turn the order around (in a game)
+//   play <track> | stop     music
+// Runs in the game task like button events, so GameEngine keeps a single writer.
+void RunCommands(GameState state) {
+	CommandReader<USART_1>::Command command;
+	CommandReader<USART_1>::Result result;
+	while ((result = commands.Next(command)) != CommandReader<USART_1>::None) {
+		if (result == CommandReader<USART_1>::Ok && RunCommand(command, state))
+			usart.Send("ok\r\n", 4);
+		else
+			usart.Send("err\r\n", 5);
+	}
+}
+
+bool RunCommand(const CommandReader<USART_1>::Command &command, GameState state) {
+	using Reader = CommandReader<USART_1>;
+	bool setup = state == StatePlayerSetup || state == StateTimerSetup || state == StateConfig;
+	bool playing = state == StateTurn || state == StateTurnEnd;
+	const auto &args = command.args;
 	
-	while (1)
-	{
-		if (plusButton.PressedDebounced()) {
-			xTaskCreate(vTaskTimerSetup, "TaskTimerSetup", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-			break;
-		}
-		else if (minusButton.PressedDebounced()) {
-			xTaskCreate(vTaskConfig, "Config", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-			break;
-		}
-		else if (bigButton.PressedDebounced()) {
-			xTaskCreate(vTaskTurnEnd, "TaskTurnEnd", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-			break;
-		} 
-		
-		else if(GameEngine::timerValue == 0 && xMusicHandle == NULL) 
-		{
-			xTaskCreate(vTaskOvertime, "vTaskOvertime", configMINIMAL_STACK_SIZE, NULL, 1, &xMusicHandle);
+	if (command.verb == Reader::Verb("add") && state == StatePlayerSetup)
+		GameEngine::AddPlayer();
+	else if (command.verb == Reader::Verb("remove") && state == StatePlayerSetup)
+		GameEngine::RemovePlayer();
+	else if (command.verb == Reader::Verb("time") && command.argc == 1 && setup && args[0] > 0)
+		GameEngine::SetTurnTime(std::min<int32_t>(args[0], UINT16_MAX));
+	else if (command.verb == Reader::Verb("score") && command.argc == 2 && args[0] >= 0)
+		return GameEngine::AdjustScore(args[0], args[1]);
+	else if (command.verb == Reader::Verb("skip") && playing)
+		GameEngine::Skip();
+	else if (command.verb == Reader::Verb("reverse") && playing)
+		GameEngine::Reverse();
+	else if (command.verb == Reader::Verb("play") && command.argc == 1 && args[0] >= 0 && args[0] < (int32_t)tracks.size())
+		return mp.Start(tracks[args[0]], true) == MusicPlayer::OK;
+	else if (command.verb == Reader::Verb("queue") && command.argc == 1 && args[0] >= 0 && args[0] < (int32_t)tracks.size())
+		return mp.Queue(tracks[args[0]], true) == MusicPlayer::OK;
+	else if (command.verb == Reader::Verb("stop"))
+		mp.Stop();
+	else
+		return false;
+	return true;
+}
+
+GameState Turn(const ButtonEvent &event) {
+	if (event.type == ButtonEvent::Chord && event.button == pauseChord) {
+		turnPaused = !turnPaused;
+		if (turnPaused) {
+			GameEngine::turnClock.Pause();
+			GameJournal::Maintain();   // nobody waits on a paused turn
 		}
-		vTaskDelayUntil(&xLastWakeTime,100);
-		led2.Toggle();
-		
+		else
+			GameEngine::turnClock.Resume();
+		return StateTurn;
+	}
+	if (event.type != ButtonEvent::Press)
+		return StateTurn;
+	
+	if (event.button == plusButton.Id())
+		return StateTimerSetup;
+	else if (event.button == minusButton.Id())
+		return StateConfig;
+	else if (event.button == bigButton.Id()) {
 #ifdef DEBUG
-		auto[minutes, seconds] = GameEngine::GetTimerValue();
-		buffer[0] = minutes;
-		buffer[1] = seconds;
-		buffer[2] = GameEngine::currentPlayer;
-		buffer[4] = GameEngine::playerScore[0];
-		buffer[5] = GameEngine::playerScore[1];
-		buffer[6] = GameEngine::playerScore[2];
-		usart.Send();
+		turnSwitchStart = CycleCounter::Now();
+		turnSwitchStamped = true;
 #endif // DEBUG
-		
-	}
-	xTimerStop(secondsTimerHandle, 0);
-	GameEngine::ResetTurnTimer();
-	if (xMusicHandle) {
-		vTaskDelete(xMusicHandle);
-		mp.Stop();
-		xMusicHandle = NULL;
+		GameEngine::EndTurn(eventAgeMs);
+		return StateTurnEnd;
 	}
-	vTaskDelete(NULL);
+	return StateTurn;
 }
 
-void vTaskTurnEnd(void *parameter) {
-	if (GameEngine::countScores) {
-		int32_t delta = 0;
-		while (1) {
-			if (bigButton.PressedDebounced()) {
-				GameEngine::ChangeScore(delta);
-				break;
-			}
-			else if (plusButton.PressedDebounced())
-			{
-				delta++;
-			}
-			else if (minusButton.PressedDebounced())
-			{
-				delta--;
-			}
-			vTaskDelay(10);
-		}
-	}
-	GameEngine::NextPlayer();
-	xTaskCreate(vTaskTurn, "TaskTurn", configMINIMAL_STACK_SIZE, NULL, 1, NULL);
-	vTaskDelete(NULL);
+// Sleeps until the turn clock crosses its next whole second (so overtime
+// starts on time), and in normal builds at most 100 ms for the led2 blink.
+TickType_t TurnWait() {
+	if (turnPaused)
+		return portMAX_DELAY;
+	int32_t remaining = GameEngine::turnClock.RemainingMs();
+	uint32_t toSecond = remaining > 0 ? (remaining - 1) % 1000 + 1 : 1000 - (uint32_t)(-remaining) % 1000;
+#ifdef LOW_POWER
+	return pdMS_TO_TICKS(toSecond) + 1;
+#else
+	return pdMS_TO_TICKS(std::min<uint32_t>(toSecond, 100)) + 1;
+#endif // LOW_POWER
 }
 
-void vTimerCallback(TimerHandle_t xTimer) {
-	if (GameEngine::timerValue > 0)
-		GameEngine::timerValue--;
+GameState TurnTick() {
+	if (GameEngine::turnClock.RemainingMs() <= 0 && !mp.Playing())
+		mp.Start(tracks[3], true);
+	if (!turnPaused)
+		led2.Toggle();
+	if (!mp.Playing())
+		GameJournal::Maintain();   // the erase would stall the music
+	
+	return StateTurn;
 }
 
-void vTaskOvertime(void *parameter) {
-	while (1)
+GameState TurnEnd(const ButtonEvent &event) {
+	if (event.type == ButtonEvent::Chord && event.button == pauseChord) {
+		GameEngine::Eliminate(GameEngine::currentPlayer);   // knocked out on this turn
+		return StateTurnEnd;
+	}
+	if (event.type != ButtonEvent::Press && event.type != ButtonEvent::Repeat)
+		return StateTurnEnd;
+	
+	if (event.button == bigButton.Id() && event.type == ButtonEvent::Press) {
+		GameEngine::ChangeScore(scoreDelta);
+		GameEngine::NextPlayer();
+#ifdef DEBUG
+		turnSwitchStart = CycleCounter::Now();
+		turnSwitchStamped = true;
+#endif // DEBUG
+		return StateTurn;
+	}
+	else if (event.button == plusButton.Id())
 	{
-		led2.SetHigh();
-		mp.Play(tracks[3]);
-		led2.SetLow();
-		vTaskDelay(1000);
+		scoreDelta++;
 	}
-}
-
-/*
-void vTaskStateMachine(void *parameter) {
-	while (1)
+	else if (event.button == minusButton.Id())
 	{
-		switch (buttonState)
-		{
-		case StateIdle:
-			{
-				if (bigButton.PressedDebounced()) 
-					buttonState = StateTurnPressed;
-				else if (minusButton.PressedDebounced()) 
-				{
-					if (plusButton.PressedDebounced())
-						buttonState = StatePlusMinusPressed;
-					else
-						buttonState = StateMinusPressed;
-				}
-				else if (plusButton.PressedDebounced()) 
-					buttonState = StatePlusPressed;
-				break;
-			}
-		default:
-			{
-				vTaskDelay(100);
-				break;
-			}
-		}
+		scoreDelta--;
 	}
+	return StateTurnEnd;
+}
+
+// Built and sent from the game task only. A frame the TX ring has no room
+// for is dropped; its sequence number is still used up, so the decoder
+// reports the gap.
+void SendTelemetry(Telemetry::Frame &frame) {
+	static std::array<uint8_t, Telemetry::maxEncoded> encoded;
+	static uint16_t sequence = 0;
+	uint16_t size = frame.Encode(sequence++, encoded);
+	if (size)
+		usart.Send((const char*)encoded.data(), size);
+}
+
+extern "C" void EXTI2_IRQHandler() {
+	Input::HandleInterrupt();
+}
+
+extern "C" void EXTI15_10_IRQHandler() {
+	Input::HandleInterrupt();
+}
+
+extern "C" void DMA1_Channel4_IRQHandler() {
+	USART_1::HandleInterrupt();
+}
+
+extern "C" void DMA1_Channel5_IRQHandler() {
+	USART_1::HandleRxInterrupt();
+}
+
+extern "C" void USART1_IRQHandler() {
+	USART_1::HandleRxInterrupt();
+}
+
+extern "C" void TIM1_UP_IRQHandler() {
+	Timebase::HandleInterrupt();
+}
+
+extern "C" void TIM1_CC_IRQHandler() {
+	MusicPlayer::HandleInterrupt();
+}
+
+#ifdef WAVETABLE
+extern "C" void DMA1_Channel2_IRQHandler() {
+	Synth::HandleInterrupt();
+}
+#else
+extern "C" void TIM2_IRQHandler() {
+	ToneVoices::HandleInterrupt(0);
+}
+
+extern "C" void TIM3_IRQHandler() {
+	ToneVoices::HandleInterrupt(1);
+}
+
+extern "C" void TIM4_IRQHandler() {
+	ToneVoices::HandleInterrupt(2);
+}
+#endif // WAVETABLE
+
+extern "C" void RTC_Alarm_IRQHandler() {
+	Rtc::HandleAlarm();
 }
-*/
 
 void vTaskLed(void *parameter) {
 	while (1)
@@ -8,15 +8,22 @@ constexpr uint32_t AHBCLK = SYSCLK;
 constexpr uint32_t APB1CLK = AHBCLK / 2;
 constexpr uint32_t APB2CLK = AHBCLK;
 
+constexpr uint32_t rtosRamBudget = 5 * 1024;   // STATIC_MEMORY: all TCBs, stacks and queues
+
 #include "FreeRTOS.h"
 #include "task.h" 
 #include "queue.h"
-#include "timers.h"
-#include <EmbeddedResources.h>
+#include <CompiledTracks.h>
 #include <utils.hpp>
 #include <periph.hpp>
+#include <Power.hpp>
 #include <Music.hpp>
 #include <GameEngine.hpp>
+#include <Journal.hpp>
+#include <Commands.hpp>
+#include <Telemetry.hpp>
+#include <Publisher.hpp>
+#include <TaskStats.hpp>
 #include <random>
 
 void MCO_out();
@@ -28,16 +35,24 @@ void vTaskButton(void *parameter);
 void vTaskDisplay(void *parameter);
 
 void vTaskBeep(void *parameter);
-void vTaskOvertime(void *parameter);
-
-void vTaskStateMachine(void *parameter);
-
-void vTaskPlayerSetup(void *parameter);
-void vTaskConfig(void *parameter);
-void vTaskTimerSetup(void *parameter);
-void vTaskTurn(void *parameter);
-void vTaskTurnEnd(void *parameter);
 
-void vTimerCallback(TimerHandle_t xTimer);
+enum GameState { StatePlayerSetup, StateTimerSetup, StateConfig, StateTurn, StateTurnEnd };
+
+void vTaskGame(void *parameter);
+void Report(bool changed);
+
+GameState EnterState(GameState state);
+void LeaveState(GameState state);
+GameState PlayerSetup(const Periph::ButtonEvent &event);
+GameState TimerSetup(const Periph::ButtonEvent &event);
+GameState Config(const Periph::ButtonEvent &event);
+GameState Turn(const Periph::ButtonEvent &event);
+GameState TurnTick();
+TickType_t TurnWait();
+GameState TurnEnd(const Periph::ButtonEvent &event);
+void ExportHistory();
+void RunCommands(GameState state);
+bool RunCommand(const CommandReader<Periph::USART_1>::Command &command, GameState state);
+void SendTelemetry(Telemetry::Frame &frame);
 
 #endif // !MAIN_H
\ No newline at end of file
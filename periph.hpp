@@ -3,7 +3,11 @@
 #include "stm32f1xx.h"
 #include "utils.hpp"
 #include "task.h"
+#include "queue.h"
+#include "rtos.hpp"
 #include "lcd_hd44780_i2c.h"
+#include <algorithm>
+#include <atomic>
 
 constexpr uint32_t portcount = 16;
 constexpr uint32_t modulo = portcount / 2;
@@ -17,19 +21,22 @@ namespace Periph
 			, pin(pinNum)
 			, controlRegister(pinNum < modulo ? portName.CRL : portName.CRH) 
 		{
-			switch ((uint32_t)&portName)
-			{
-			case (GPIOA_BASE) : { RCC->APB2ENR |= RCC_APB2ENR_IOPAEN; }
-				break;
-			case (GPIOB_BASE) : { RCC->APB2ENR |= RCC_APB2ENR_IOPBEN; }
-				break;
-			case (GPIOC_BASE) : { RCC->APB2ENR |= RCC_APB2ENR_IOPCEN; }
-				break;
-			case (GPIOD_BASE) : { RCC->APB2ENR |= RCC_APB2ENR_IOPDEN; }
-				break;
-			}
+			// compared as pointers so the host register mock (sim/) works too
+			if (&portName == GPIOA) { RCC->APB2ENR |= RCC_APB2ENR_IOPAEN; }
+			else if (&portName == GPIOB) { RCC->APB2ENR |= RCC_APB2ENR_IOPBEN; }
+			else if (&portName == GPIOC) { RCC->APB2ENR |= RCC_APB2ENR_IOPCEN; }
+			else if (&portName == GPIOD) { RCC->APB2ENR |= RCC_APB2ENR_IOPDEN; }
 		}
 		;
+		
+		inline GPIO_TypeDef &Port() const { return port; }
+		inline uint32_t Number() const { return pin; }
+		inline uint32_t PortIndex() const { // AFIO_EXTICR encoding: A = 0, B = 1, ...
+			if (&port == GPIOB) return 1;
+			if (&port == GPIOC) return 2;
+			if (&port == GPIOD) return 3;
+			return 0;
+		}
 	protected:
 		GPIO_TypeDef &port;
 		uint32_t pin;
@@ -75,6 +82,21 @@ namespace Periph
 		};
 			
 		inline bool State() const { return utils::checkBit(this->port.IDR, this->pin); }
+		
+		inline void EnableInterrupt() const {
+			RCC->APB2ENR |= RCC_APB2ENR_AFIOEN;
+			AFIO->EXTICR[this->pin / 4] &= ~(0xF << 4*(this->pin % 4));   // route EXTI line to this port
+			AFIO->EXTICR[this->pin / 4] |= (PortIndex() << 4*(this->pin % 4));
+			utils::setBit(EXTI->RTSR, this->pin);   // both edges: press and release
+			utils::setBit(EXTI->FTSR, this->pin);
+			EXTI->PR = (1U << this->pin);   // write 1 to clear
+			utils::setBit(EXTI->IMR, this->pin);
+			
+			IRQn_Type irq = this->pin < 5 ? (IRQn_Type)(EXTI0_IRQn + this->pin)
+				: this->pin < 10 ? EXTI9_5_IRQn : EXTI15_10_IRQn;
+			NVIC_SetPriority(irq, configLIBRARY_KERNEL_INTERRUPT_PRIORITY);   // must not preempt the kernel
+			NVIC_EnableIRQ(irq);
+		}
 	};
 	
 	class Led {
@@ -92,7 +114,6 @@ namespace Periph
 
 	class Button {
 	public:
-		static inline uint32_t debounceTimeout = 5; // c++17
 		enum ButtonType { NO, NC };
 		Button(InPin buttonPin, ButtonType buttonType)
 			: pin(buttonPin)
@@ -100,25 +121,242 @@ namespace Periph
 		;
 			
 		inline bool Pressed() const { return (pin.State() ^ type); };
-		inline bool PressedDebounced() {
-			if (this->Pressed()) {
-				vTaskDelay(debounceTimeout);
-				if (this->Pressed()) {
-					return true;
-				}
-				else return false;
-			}
-			else return false;
-		}
+		inline uint32_t Line() const { return pin.Number(); }
+		inline bool Inverted() const { return type == NC; }
+		inline uint8_t Id() const { return id; }
 			
 		private:
+		friend class Input;
 		InPin pin;
 		ButtonType type;
+		uint8_t id = 0;
+	};
+	
+	struct ButtonEvent {
+		enum EventType : uint8_t { Press, Release, LongPress, Repeat, Chord, Frame };
+		uint8_t button;   // Button::Id(), the Input::AddChord() index for Chord, unused for Frame (USART_1 received data)
+		EventType type;
+		TickType_t timestamp;   // tick of the scan that produced the event
+	};
+	
+	// Buttons are debounced per GPIO port: every scan reads each IDR once and runs
+	// a 2-bit vertical counter over all of its bits, so the cost does not grow
+	// with the number of buttons. EXTI only wakes the scanner, which stops again
+	// once everything is released and settled.
+	class Input {
+	public:
+		static constexpr uint8_t maxButtons = 16;
+		static constexpr uint8_t maxPorts = 4;
+		static constexpr uint8_t maxChords = 4;
+		static constexpr uint32_t queueLength = 8;
+		static inline TickType_t scanPeriod = 2;   // 4 equal samples in a row = 8 ms debounce
+		static inline TickType_t chordWindow = 50;   // chord members must all go down within it
+		static inline TickType_t longPressTime = 600;
+		static inline TickType_t repeatPeriod = 150;
+		
+		static inline void Register(Button &button) {
+			assert(count < maxButtons);
+			assert(!utils::checkBit(lineMask, button.Line()));   // EXTI line can serve one port only
+			
+			uint8_t i = 0;
+			while (i < portsUsed && ports[i].gpio != &button.pin.Port())
+				i++;
+			if (i == portsUsed) {
+				assert(portsUsed < maxPorts);
+				ports[portsUsed++].gpio = &button.pin.Port();
+			}
+			
+			auto &port = ports[i];
+			utils::setBit(port.mask, button.Line());
+			if (button.Inverted())
+				utils::setBit(port.invert, button.Line());
+			port.ids[button.Line()] = count;
+			
+			button.id = count;
+			buttons[count++] = &button;
+			utils::setBit(lineMask, button.Line());
+		}
+		
+		// returns the chord index reported in ButtonEvent::button
+		static inline uint8_t AddChord(std::initializer_list<const Button*> members) {
+			assert(chordsUsed < maxChords);
+			uint32_t chord = 0;
+			for (auto button : members)
+				utils::setBit(chord, button->Id());
+			chords[chordsUsed] = chord;
+			chordMembers |= chord;
+			return chordsUsed++;
+		}
+		
+		static inline void Start() {
+			queue.Create();
+			scanTask.Create(vTaskScan, "Input", 2);
+			for (uint8_t i = 0; i < portsUsed; i++)
+				ports[i].state = Sample(ports[i]);
+			for (uint8_t i = 0; i < count; i++)
+				buttons[i]->pin.EnableInterrupt();
+		}
+		
+		static inline bool Receive(ButtonEvent &event, TickType_t timeout) {
+			return xQueueReceive(queue.Handle(), &event, timeout) == pdTRUE;
+		}
+		
+		// for event sources other than buttons; false if the queue is full or not created yet
+		static inline bool PostFromISR(const ButtonEvent &event) {
+			if (queue.Handle() == NULL)
+				return false;
+			BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+			bool posted = xQueueSendFromISR(queue.Handle(), &event, &xHigherPriorityTaskWoken) == pdTRUE;
+			portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+			return posted;
+		}
+		
+		// call from the EXTIx_IRQHandler of every registered line
+		static inline void HandleInterrupt() {
+			EXTI->PR = EXTI->PR & lineMask;   // write 1 to clear
+			EXTI->IMR &= ~lineMask;   // scanner takes over until everything settles
+			
+			BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+			vTaskNotifyGiveFromISR(scanTask.Handle(), &xHigherPriorityTaskWoken);
+			portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+		}
+		
+	private:
+		struct Port {
+			GPIO_TypeDef *gpio;
+			uint16_t mask;
+			uint16_t invert;   // NC buttons
+			uint16_t state;   // debounced, 1 = pressed
+			uint16_t cnt0;   // vertical counter, one bit per pin
+			uint16_t cnt1;
+			std::array<uint8_t, portcount> ids;
+		};
+		
+		static inline uint16_t Sample(const Port &port) {
+			return (port.gpio->IDR ^ port.invert) & port.mask;
+		}
+		
+		static inline void Post(uint8_t button, ButtonEvent::EventType type, TickType_t now) {
+			ButtonEvent event = { button, type, now };
+			xQueueSend(queue.Handle(), &event, 0);
+		}
+		
+		static void vTaskScan(void *) {
+			while (1)
+			{
+				ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+				
+				TickType_t xLastWakeTime = xTaskGetTickCount();
+				do {
+					vTaskDelayUntil(&xLastWakeTime, scanPeriod);
+				} while (Scan(xLastWakeTime));
+				
+				taskENTER_CRITICAL();
+				EXTI->PR = lineMask;
+				EXTI->IMR |= lineMask;
+				taskEXIT_CRITICAL();
+				
+				// an edge between the last scan and re-arming would otherwise be lost
+				for (uint8_t i = 0; i < portsUsed; i++) {
+					if (Sample(ports[i]) != ports[i].state) {
+						xTaskNotifyGive(scanTask.Handle());
+						break;
+					}
+				}
+			}
+		}
+		
+		// returns true while any button is held, bouncing or waiting for a chord
+		static inline bool Scan(TickType_t now) {
+			uint32_t pressed = 0;
+			uint32_t released = 0;
+			bool settling = false;
+			
+			for (uint8_t i = 0; i < portsUsed; i++) {
+				auto &port = ports[i];
+				uint16_t delta = Sample(port) ^ port.state;
+				port.cnt1 = (port.cnt1 ^ port.cnt0) & delta;
+				port.cnt0 = ~port.cnt0 & delta;
+				uint16_t toggle = delta & ~(port.cnt0 | port.cnt1);
+				port.state ^= toggle;
+				settling |= (delta != toggle);
+				
+				for (uint32_t bits = toggle; bits; bits &= bits - 1) {
+					uint32_t pin = __builtin_ctz(bits);
+					if (utils::checkBit(port.state, pin))
+						utils::setBit(pressed, port.ids[pin]);
+					else
+						utils::setBit(released, port.ids[pin]);
+				}
+			}
+			
+			held = (held | pressed) & ~released;
+			for (uint32_t bits = pressed; bits; bits &= bits - 1)
+				nextTime[__builtin_ctz(bits)] = now + longPressTime;
+			
+			// chord members are held back for chordWindow to see if the rest follows
+			if (pressed & chordMembers) {
+				if (!pending)
+					pendingSince = now;
+				pending |= pressed & chordMembers;
+			}
+			for (uint32_t bits = pressed & ~chordMembers; bits; bits &= bits - 1)
+				Post(__builtin_ctz(bits), ButtonEvent::Press, now);
+			
+			for (uint8_t c = 0; c < chordsUsed; c++) {
+				if ((pending & chords[c]) == chords[c]) {
+					Post(c, ButtonEvent::Chord, now);
+					pending &= ~chords[c];
+					consumed |= chords[c];
+				}
+			}
+			
+			uint32_t flush = (now - pendingSince >= chordWindow) ? pending : (pending & released);
+			for (uint32_t bits = flush; bits; bits &= bits - 1)
+				Post(__builtin_ctz(bits), ButtonEvent::Press, now);
+			pending &= ~flush;
+			
+			for (uint32_t bits = released; bits; bits &= bits - 1)
+				Post(__builtin_ctz(bits), ButtonEvent::Release, now);
+			consumed &= ~released;
+			longFired &= ~released;
+			
+			for (uint32_t bits = held & ~pending & ~consumed; bits; bits &= bits - 1) {
+				uint32_t id = __builtin_ctz(bits);
+				if ((int32_t)(now - nextTime[id]) < 0)
+					continue;
+				Post(id, utils::checkBit(longFired, id) ? ButtonEvent::Repeat : ButtonEvent::LongPress, now);
+				utils::setBit(longFired, id);
+				nextTime[id] += repeatPeriod;
+			}
+			
+			return settling || held || pending;
+		}
+		
+		static inline std::array<Button*, maxButtons> buttons;
+		static inline std::array<Port, maxPorts> ports;
+		static inline std::array<uint32_t, maxChords> chords;
+		static inline std::array<TickType_t, maxButtons> nextTime;   // next LongPress/Repeat
+		static inline uint32_t held = 0;
+		static inline uint32_t pending = 0;   // chord members not reported yet
+		static inline uint32_t consumed = 0;   // already reported as part of a chord
+		static inline uint32_t longFired = 0;
+		static inline uint32_t chordMembers = 0;
+		static inline TickType_t pendingSince = 0;
+		static inline uint32_t lineMask = 0;
+		static inline uint8_t count = 0;
+		static inline uint8_t portsUsed = 0;
+		static inline uint8_t chordsUsed = 0;
+		static inline Rtos::Queue<ButtonEvent, queueLength> queue;
+		static inline Rtos::Task<> scanTask;
+		
+	public:
+		static constexpr uint32_t staticRam = sizeof(queue) + sizeof(scanTask);
 	};
 	
 	class USART_1 {
 	public:
-		USART_1(const OutPin txPin, const InPin rxPin, uint32_t baudrate, const std::array<char, 8> &buf)
+		USART_1(const OutPin txPin, const InPin rxPin, uint32_t baudrate)
 			: tx(txPin)
 			, rx(rxPin)
 		{
@@ -135,9 +373,7 @@ namespace Periph
 			RCC->AHBENR |= RCC_AHBENR_DMA1EN;  //	enable DMA
 				
 			//send
-			DMA1_Channel4->CPAR = (uint32_t)&USART1->DR;
-			DMA1_Channel4->CMAR = (uint32_t)buf.begin();
-			DMA1_Channel4->CNDTR = 8;
+			DMA1_Channel4->CPAR = (uintptr_t)&USART1->DR;
 				
 			DMA1_Channel4->CCR  &=	~DMA_CCR_CIRC;  								// Disable cycle mode
 			DMA1_Channel4->CCR  &=	~DMA_CCR_PINC;  								// Disable increment pointer periphery
@@ -147,70 +383,415 @@ namespace Periph
 				
 			DMA1_Channel4->CCR	|=	DMA_CCR_DIR;
 			DMA1_Channel4->CCR  |=	DMA_CCR_MINC;  								// Enable increment pointer memory
+			DMA1_Channel4->CCR  |=	DMA_CCR_TCIE;  								// chains the next chunk
 				
 			USART1->CR3 |= USART_CR3_DMAT; 
+			
+			NVIC_SetPriority(DMA1_Channel4_IRQn, configLIBRARY_KERNEL_INTERRUPT_PRIORITY);
+			NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+			
+			//receive: circular into rxRing, IDLE marks the end of a frame and the
+			//half/full interrupts cover input longer than half the ring
+			DMA1_Channel5->CPAR = (uintptr_t)&USART1->DR;
+			DMA1_Channel5->CMAR = (uintptr_t)rxRing.data();
+			DMA1_Channel5->CNDTR = rxRingSize;
+			DMA1_Channel5->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE;   // periphery -> memory, 8 bit
+			DMA1_Channel5->CCR |= DMA_CCR_EN;
+			
+			USART1->CR3 |= USART_CR3_DMAR;
+			USART1->CR1 |= USART_CR1_IDLEIE;
+			
+			NVIC_SetPriority(DMA1_Channel5_IRQn, configLIBRARY_KERNEL_INTERRUPT_PRIORITY);
+			NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+			NVIC_SetPriority(USART1_IRQn, configLIBRARY_KERNEL_INTERRUPT_PRIORITY);
+			NVIC_EnableIRQ(USART1_IRQn);
 		}
 		;
 			
-		void Send() {
-			DMA1_Channel4->CCR  &= ~DMA_CCR_EN;      
-			DMA1_Channel4->CNDTR =  8;      
-			DMA1->IFCR          |=  DMA_IFCR_CTCIF4;   							// Status flag end of exchange
+		// Copies 'data' into the TX ring and returns at once; tasks and ISRs
+		// may call it concurrently. All or nothing: false when the ring has no
+		// room, the caller decides whether to wait or drop.
+		//
+		// 'claim' packs the reserved end of the ring (low half) with the
+		// number of writers still copying (high half). The writer that brings
+		// the count to zero makes everything reserved so far visible to the
+		// DMA, so a preempted writer only holds back bytes queued after its own.
+		static bool Send(const char *data, uint16_t size) {
+			uint32_t current = claim.load(std::memory_order_relaxed);
+			uint16_t start;
+			do {
+				start = current & 0xFFFF;
+				uint16_t used = start - sent.load(std::memory_order_acquire);
+				if (size > txRingSize - used)
+					return false;
+			} while (!claim.compare_exchange_weak(current, ((current >> 16) + 1) << 16 | (uint16_t)(start + size),
+				std::memory_order_acquire, std::memory_order_relaxed));
+			
+			for (uint16_t i = 0; i < size; i++)
+				txRing[(uint16_t)(start + i) % txRingSize] = data[i];
+			
+			current = claim.load(std::memory_order_relaxed);
+			while (!claim.compare_exchange_weak(current, current - (1 << 16), std::memory_order_release, std::memory_order_relaxed)) {}
+			if ((current >> 16) == 1)
+				Commit(current & 0xFFFF);
+			// an idle channel is restarted from its interrupt, the only place that touches it
+			if (!(DMA1_Channel4->CCR & DMA_CCR_EN))
+				NVIC_SetPendingIRQ(DMA1_Channel4_IRQn);
+			return true;
+		}
+		
+		// DMA1_Channel4: retires the finished chunk and starts the next one,
+		// as long as possible without wrapping
+		static void HandleInterrupt() {
+			if (DMA1->ISR & DMA_ISR_TCIF4) {
+				DMA1->IFCR = DMA_IFCR_CTCIF4;
+				sent.store(sent.load(std::memory_order_relaxed) + inFlight, std::memory_order_release);
+				inFlight = 0;
+			}
+			if (inFlight)
+				return;
+			DMA1_Channel4->CCR &= ~DMA_CCR_EN;
+			uint16_t from = sent.load(std::memory_order_relaxed);
+			uint16_t waiting = committed.load(std::memory_order_acquire) - from;
+			if (!waiting)
+				return;
+			uint16_t offset = from % txRingSize;
+			inFlight = std::min<uint16_t>(waiting, txRingSize - offset);
+			DMA1_Channel4->CMAR = (uintptr_t)&txRing[offset];
+			DMA1_Channel4->CNDTR = inFlight;
 			DMA1_Channel4->CCR |= DMA_CCR_EN;
 		}
-			
-		//uint32_t txBufferSize;
+		
+		// USART1 (IDLE) and DMA1_Channel5 (half/full): posts one Frame event
+		// until the reader calls RxEnd() again, no matter how many bytes came in
+		static void HandleRxInterrupt() {
+			if (USART1->SR & USART_SR_IDLE)
+				(void)USART1->DR;   // SR then DR read clears IDLE
+			DMA1->IFCR = DMA_IFCR_CGIF5 | DMA_IFCR_CHTIF5 | DMA_IFCR_CTCIF5;
+			if (!rxSignalled.load(std::memory_order_relaxed)
+				&& Input::PostFromISR(ButtonEvent{ 0, ButtonEvent::Frame, xTaskGetTickCountFromISR() }))
+				rxSignalled.store(true, std::memory_order_relaxed);
+		}
+		
+		// The received bytes are read in place: RxAt(position) for positions up
+		// to RxEnd(), both wrapping at rxRingSize. Input that gets more than a
+		// ring ahead of the reader is overwritten.
+		static inline uint16_t RxEnd() {
+			rxSignalled.store(false, std::memory_order_relaxed);
+			return (rxRingSize - DMA1_Channel5->CNDTR) % rxRingSize;
+		}
+		
+		static inline char RxAt(uint16_t position) { return rxRing[position % rxRingSize]; }
+		
+		// something queued has not gone out yet
+		static inline bool Busy() { return (uint16_t)claim.load(std::memory_order_acquire) != sent.load(std::memory_order_acquire); }
+		
+		static constexpr uint16_t txRingSize = 512;   // must divide 65536, positions are free-running uint16_t
+		static constexpr uint16_t rxRingSize = 128;
 			
 		private :
+		// raise 'committed' to 'end' unless a later commit got there first
+		static inline void Commit(uint16_t end) {
+			uint16_t current = committed.load(std::memory_order_relaxed);
+			while ((int16_t)(end - current) > 0
+				&& !committed.compare_exchange_weak(current, end, std::memory_order_release, std::memory_order_relaxed)) {}
+		}
+		
 		InPin rx;
 		OutPin tx;
 		
+		static inline std::array<char, txRingSize> txRing;
+		static inline std::atomic<uint32_t> claim = 0;       // writers << 16 | reserved end
+		static inline std::atomic<uint16_t> committed = 0;   // end of the bytes the DMA may take
+		static inline std::atomic<uint16_t> sent = 0;        // end of the bytes on the wire
+		static inline uint16_t inFlight = 0;                 // size of the chunk the DMA is on
+		
+		static inline std::array<volatile char, rxRingSize> rxRing;
+		static inline std::atomic<bool> rxSignalled = false;   // a Frame event is on its way
+		
 	};
 	
-	class Timer {
+	// A free-running timer whose compare channels each toggle their own pin
+	// on a match. The CC interrupt handler moves a channel's compare on by
+	// the next half period, so every channel plays its own frequency.
+	class ToneTimer {
 	public:
-		static constexpr uint32_t PWM_COUNTS = 1000;
-		static constexpr uint32_t PWM_MAX = SYSCLK / PWM_COUNTS;
-		Timer(TIM_TypeDef &timerName, OutPin pin) : timer(timerName)
+		static constexpr uint8_t channels = 4;
+		
+		ToneTimer(TIM_TypeDef &timerName, IRQn_Type irq, uint32_t frequency) : timer(timerName)
 		{
-			switch ((uint32_t)&timerName)
-			{
-			//case (TIM1_BASE) : { RCC->APB2ENR |= RCC_APB2ENR_TIM1EN; }
-			//	break;
-			case (TIM2_BASE) : { RCC->APB1ENR |= RCC_APB1ENR_TIM2EN; }
-				break;
-			case (TIM3_BASE) : { RCC->APB1ENR |= RCC_APB1ENR_TIM3EN; }
-				break;
-			case (TIM4_BASE) : { RCC->APB1ENR |= RCC_APB1ENR_TIM4EN; }
-				break;
-			}
+			if (&timerName == TIM2) { RCC->APB1ENR |= RCC_APB1ENR_TIM2EN; }
+			else if (&timerName == TIM3) { RCC->APB1ENR |= RCC_APB1ENR_TIM3EN; }
+			else if (&timerName == TIM4) { RCC->APB1ENR |= RCC_APB1ENR_TIM4EN; }
+			timer.PSC = SYSCLK / frequency - 1;   // APB1 timers run at 2 * APB1CLK
+			timer.ARR = 0xFFFF;
+			timer.EGR = TIM_EGR_UG;
+			for (uint8_t channel = 0; channel < channels; channel++)
+				Mute(channel);
+			// above configMAX_SYSCALL_INTERRUPT_PRIORITY (11): critical sections
+			// do not delay the edges, the handler makes no kernel calls
+			NVIC_SetPriority(irq, 10);
+			NVIC_EnableIRQ(irq);
+			timer.CR1 |= TIM_CR1_CEN;
 		}
 		
-		inline void PWM_Init() {
-			PWM_SetFrequency(PWM_MAX);
-			PWM_SetParam(1000, 500);
-			
-			timer.CCMR1 |= TIM_CCMR1_OC2M_1 | TIM_CCMR1_OC2M_2;  // enable PWM mode 1 on channel
-			timer.CCER |= TIM_CCER_CC2E;  // enable 
-			timer.CCER &= ~TIM_CCER_CC2P;  // straigt polarity
-			
-			timer.CR1 &= ~TIM_CR1_DIR;   // count up
-			timer.CR1 |= TIM_CR1_CEN;    // enable timer
+		// pin held low, no more compare interrupts
+		inline void Mute(uint8_t channel) {
+			timer.DIER &= ~(TIM_DIER_CC1IE << channel);
+			SetMode(channel, forceLow);
 		}
 		
-		inline void PWM_SetParam(uint32_t ARR, uint32_t CCR2) {
-			timer.ARR = ARR;    // counts
-			timer.CCR2 = CCR2;    // counts till enable (duty cycle)
+		// toggling from low, the first time at count 'first'
+		inline void Start(uint8_t channel, uint16_t first) {
+			Compare(channel) = first;
+			timer.SR = ~(TIM_SR_CC1IF << channel);
+			SetMode(channel, toggle);
+			timer.CCER |= TIM_CCER_CC1E << (4 * channel);
+			timer.DIER |= TIM_DIER_CC1IE << channel;
 		}
 		
-		inline void PWM_SetFrequency(uint32_t freq) {
-			assert(freq > 0);
-			timer.PSC = (SYSCLK / 1000 / freq) - 1;
+		// Hold() keeps the handler off the channel, a match in between is
+		// handled on Resume()
+		inline void Hold(uint8_t channel) { timer.DIER &= ~(TIM_DIER_CC1IE << channel); }
+		inline void Resume(uint8_t channel) { timer.DIER |= TIM_DIER_CC1IE << channel; }
+		
+		inline volatile uint32_t &Compare(uint8_t channel) { return (&timer.CCR1)[channel]; }
+		inline uint16_t Now() const { return timer.CNT; }
+		
+		// bit n: channel n matched with its interrupt on; clears them
+		inline uint32_t TakeMatches() {
+			uint32_t matched = timer.SR & timer.DIER & (TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC3IF | TIM_SR_CC4IF);
+			timer.SR = ~matched;
+			return matched / TIM_SR_CC1IF;
+		}
+		
+	private:
+		enum Mode : uint32_t { toggle = 3, forceLow = 4 };   // OCxM
+		
+		inline void SetMode(uint8_t channel, Mode mode) {
+			volatile uint32_t &ccmr = channel < 2 ? timer.CCMR1 : timer.CCMR2;
+			uint32_t shift = 4 + 8 * (channel % 2);
+			ccmr = (ccmr & ~(7U << shift)) | mode << shift;
 		}
 		
-	protected:
 		TIM_TypeDef &timer;
 	};
+	
+	// TIM2 CH2 (PA1) as a DAC: 12-bit PWM at SYSCLK / 4096 (17.6 kHz, one
+	// sample per period), the compare reloaded from a circular buffer by
+	// DMA1 channel 2 on every update. The compare is preloaded, so a sample
+	// always starts with a period.
+	class PwmDac {
+	public:
+		static constexpr uint32_t resolution = 4096;
+		static constexpr uint32_t rate = SYSCLK / resolution;   // samples per second
+		static constexpr uint16_t middle = resolution / 2;
+		
+		static inline void Init() {
+			RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;
+			RCC->AHBENR |= RCC_AHBENR_DMA1EN;
+			TIM2->PSC = 0;   // APB1 timers run at 2 * APB1CLK
+			TIM2->ARR = resolution - 1;
+			TIM2->CCR2 = middle;
+			TIM2->CCMR1 = (TIM2->CCMR1 & ~TIM_CCMR1_OC2M) | TIM_CCMR1_OC2M_2 | TIM_CCMR1_OC2M_1 | TIM_CCMR1_OC2PE;   // PWM mode 1
+			TIM2->CCER |= TIM_CCER_CC2E;
+			TIM2->EGR = TIM_EGR_UG;
+			DMA1_Channel2->CPAR = (uintptr_t)&TIM2->CCR2;
+			NVIC_SetPriority(DMA1_Channel2_IRQn, configLIBRARY_KERNEL_INTERRUPT_PRIORITY);
+			NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+		}
+		
+		// plays the 'count' samples at 'buffer' round and round; each half
+		// raises the interrupt once it has gone out
+		static inline void Start(const uint16_t *buffer, uint16_t count) {
+			DMA1_Channel2->CCR = 0;
+			DMA1_Channel2->CMAR = (uintptr_t)buffer;
+			DMA1_Channel2->CNDTR = count;
+			DMA1->IFCR = DMA_IFCR_CGIF2 | DMA_IFCR_CHTIF2 | DMA_IFCR_CTCIF2;
+			DMA1_Channel2->CCR = DMA_CCR_DIR | DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_PSIZE_0 | DMA_CCR_MSIZE_0
+				| DMA_CCR_HTIE | DMA_CCR_TCIE;   // memory -> timer, 16 bit
+			DMA1_Channel2->CCR |= DMA_CCR_EN;
+			TIM2->DIER |= TIM_DIER_UDE;
+			TIM2->CR1 |= TIM_CR1_CEN;
+		}
+		
+		static inline void Stop() {
+			TIM2->CR1 &= ~TIM_CR1_CEN;
+			TIM2->DIER &= ~TIM_DIER_UDE;
+			DMA1_Channel2->CCR = 0;
+			TIM2->CCR2 = middle;
+		}
+		
+		// bit 0: the first half has gone out and can be refilled, bit 1: the
+		// second; clears them
+		static inline uint32_t TakeHalves() {
+			uint32_t flags = DMA1->ISR & (DMA_ISR_HTIF2 | DMA_ISR_TCIF2);
+			DMA1->IFCR = flags | DMA_IFCR_CGIF2;
+			return (flags & DMA_ISR_HTIF2 ? 1 : 0) | (flags & DMA_ISR_TCIF2 ? 2 : 0);
+		}
+	};
+	
+	class CycleCounter {
+	public:
+		static inline void Init() {
+			CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+			DWT->CYCCNT = 0;
+			DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+		}
+		
+		static inline uint32_t Now() { return DWT->CYCCNT; }   // SYSCLK cycles, wraps every ~60 s
+	};
+	
+	// TIM1 free-running at 'frequency', widened to 32 bits by counting update
+	// events. Wraps after ~59 h, well past any game night. Shared by
+	// TaskStats and the music sequencer; whichever comes first starts it.
+	class Timebase {
+	public:
+		static constexpr uint32_t frequency = 20000;
+		
+		static inline void Init() {
+			if (TIM1->CR1 & TIM_CR1_CEN)
+				return;
+			RCC->APB2ENR |= RCC_APB2ENR_TIM1EN;
+			TIM1->PSC = APB2CLK / frequency - 1;
+			TIM1->ARR = 0xFFFF;
+			TIM1->EGR = TIM_EGR_UG;   // load PSC now, not at the first wrap
+			TIM1->SR = ~TIM_SR_UIF;
+			TIM1->DIER |= TIM_DIER_UIE;
+			NVIC_SetPriority(TIM1_UP_IRQn, configLIBRARY_KERNEL_INTERRUPT_PRIORITY);
+			NVIC_EnableIRQ(TIM1_UP_IRQn);
+			TIM1->CR1 |= TIM_CR1_CEN;
+		}
+		
+		// Safe from any context: a wrap whose interrupt is still pending (we are
+		// in a critical section or a higher-priority ISR) is accounted for here.
+		static inline uint32_t Now() {
+			uint32_t high, low;
+			bool wrapped;
+			do {
+				high = overflows;
+				low = TIM1->CNT;
+				wrapped = (TIM1->SR & TIM_SR_UIF) && low < 0x8000;
+			} while (high != overflows);
+			return ((high + wrapped) << 16) | low;
+		}
+		
+		static inline void HandleInterrupt() {
+			if (TIM1->SR & TIM_SR_UIF) {
+				TIM1->SR = ~TIM_SR_UIF;
+				overflows = overflows + 1;
+			}
+		}
+		
+	private:
+		static inline volatile uint32_t overflows = 0;
+	};
+	
+	// Internal flash programming, one halfword at a time. Instruction fetches
+	// stall while the flash is busy: ~50 us per halfword, ~20 ms per page erase.
+	class Flash {
+	public:
+		static constexpr uint32_t pageSize = 1024;   // F103 medium density
+		
+		static inline void Unlock() {
+			if (FLASH->CR & FLASH_CR_LOCK) {
+				FLASH->KEYR = FLASH_KEY1;
+				FLASH->KEYR = FLASH_KEY2;
+			}
+		}
+		
+		static inline void Lock() { FLASH->CR |= FLASH_CR_LOCK; }
+		
+		// only 1 bits can be cleared, the halfword must be erased (0xFFFF) first
+		static inline void Program(uintptr_t address, uint16_t value) {
+			FLASH->CR |= FLASH_CR_PG;
+			*reinterpret_cast<volatile uint16_t*>(address) = value;
+			while (FLASH->SR & FLASH_SR_BSY) {}
+			FLASH->CR &= ~FLASH_CR_PG;
+		}
+		
+		static inline void ErasePage(uintptr_t address) {
+			FLASH->CR |= FLASH_CR_PER;
+			FLASH->AR = address;
+			FLASH->CR |= FLASH_CR_STRT;
+			while (FLASH->SR & FLASH_SR_BSY) {}
+			FLASH->CR &= ~FLASH_CR_PER;
+		}
+		
+		static inline uint16_t Read(uintptr_t address) { return *reinterpret_cast<const volatile uint16_t*>(address); }
+	};
+	
+	// RTC on the 32.768 kHz LSE, counting 1/frequency s. Drives the turn clock,
+	// and since it keeps running in STOP mode it also times LOW_POWER sleeps.
+	class Rtc {
+	public:
+		static constexpr uint32_t frequency = 1024;
+		static constexpr uint32_t alarmLine = 17;   // EXTI line of the alarm
+		
+		static inline void Init() {
+			RCC->APB1ENR |= RCC_APB1ENR_PWREN | RCC_APB1ENR_BKPEN;
+			PWR->CR |= PWR_CR_DBP;   // unlock the backup domain
+			if (!(RCC->BDCR & RCC_BDCR_RTCEN)) {
+				RCC->BDCR |= RCC_BDCR_LSEON;
+				while (!(RCC->BDCR & RCC_BDCR_LSERDY)) {}
+				RCC->BDCR |= RCC_BDCR_RTCSEL_LSE | RCC_BDCR_RTCEN;
+			}
+			Sync();
+			Configure([] {
+				RTC->PRLH = 0;
+				RTC->PRLL = 32768 / frequency - 1;
+			});
+		}
+		
+		// registers read stale after reset or STOP until the APB1 side resynchronises
+		static inline void Sync() {
+			RTC->CRL &= ~RTC_CRL_RSF;
+			while (!(RTC->CRL & RTC_CRL_RSF)) {}
+		}
+		
+		static inline uint32_t Now() {
+			uint32_t high, low;
+			do {
+				high = RTC->CNTH;
+				low = RTC->CNTL;
+			} while (high != RTC->CNTH);
+			return (high << 16) | low;
+		}
+		
+		// the flag is raised when the counter reaches 'time' exactly
+		static inline void SetAlarm(uint32_t time) {
+			Configure([time] {
+				RTC->ALRH = time >> 16;
+				RTC->ALRL = time & 0xFFFF;
+			});
+		}
+		
+		static inline void EnableAlarmInterrupt() {
+			EXTI->IMR |= (1U << alarmLine);
+			EXTI->RTSR |= (1U << alarmLine);
+			while (!(RTC->CRL & RTC_CRL_RTOFF)) {}
+			RTC->CRH |= RTC_CRH_ALRIE;
+			NVIC_SetPriority(RTC_Alarm_IRQn, configLIBRARY_KERNEL_INTERRUPT_PRIORITY);
+			NVIC_EnableIRQ(RTC_Alarm_IRQn);
+		}
+		
+		static inline void HandleAlarm() {
+			EXTI->PR = (1U << alarmLine);
+			while (!(RTC->CRL & RTC_CRL_RTOFF)) {}
+			RTC->CRL &= ~RTC_CRL_ALRF;
+		}
+		
+	private:
+		// PRL, CNT and ALR only take writes in configuration mode
+		template<typename Write>
+		static inline void Configure(Write write) {
+			while (!(RTC->CRL & RTC_CRL_RTOFF)) {}
+			RTC->CRL |= RTC_CRL_CNF;
+			write();
+			RTC->CRL &= ~RTC_CRL_CNF;
+			while (!(RTC->CRL & RTC_CRL_RTOFF)) {}
+		}
+	};
 }
 
 void RCC_Init() {
@@ -279,3 +860,15 @@ void RCC_Init() {
 	while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL) {} 		// wait till PLL is used
 	
 }
+
+// STOP mode falls back to HSI with HSE and the PLL off; prescalers and the
+// PLL setup survive, so only the oscillators need restarting.
+void RCC_Resume() {
+	RCC->CR |= RCC_CR_HSEON;
+	while (!(RCC->CR & RCC_CR_HSERDY)) {}
+	RCC->CR |= RCC_CR_PLLON;
+	while ((RCC->CR & RCC_CR_PLLRDY) == 0) {}
+	RCC->CFGR &= ~RCC_CFGR_SW;
+	RCC->CFGR |= RCC_CFGR_SW_PLL;
+	while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL) {}
+}
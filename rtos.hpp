@@ -0,0 +1,78 @@
+#pragma once
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "utils.hpp"
+
+// Thin owners for kernel objects. With STATIC_MEMORY (configSUPPORT_STATIC_ALLOCATION)
+// the TCB, stack and queue storage live inside the object itself, so every
+// kernel object is a plain global and shows up in the linker's .bss size.
+// Otherwise they fall back to the heap. Either way a failed create asserts.
+namespace Rtos
+{
+	template<uint32_t StackDepth = configMINIMAL_STACK_SIZE>
+	class Task {
+	public:
+		static constexpr uint32_t stackDepth = StackDepth;
+
+		inline TaskHandle_t Create(TaskFunction_t function, const char *name, UBaseType_t priority, void *parameter = NULL) {
+#if configSUPPORT_STATIC_ALLOCATION
+			handle = xTaskCreateStatic(function, name, StackDepth, parameter, priority, stack.data(), &tcb);
+#else
+			if (xTaskCreate(function, name, StackDepth, parameter, priority, &handle) != pdPASS)
+				handle = NULL;
+#endif
+			assert(handle != NULL);
+			return handle;
+		}
+
+		inline TaskHandle_t Handle() const { return handle; }
+
+	private:
+#if configSUPPORT_STATIC_ALLOCATION
+		StaticTask_t tcb;
+		std::array<StackType_t, StackDepth> stack;
+#endif
+		TaskHandle_t handle = NULL;
+	};
+
+	template<typename T, uint32_t Length>
+	class Queue {
+	public:
+		inline QueueHandle_t Create() {
+#if configSUPPORT_STATIC_ALLOCATION
+			handle = xQueueCreateStatic(Length, sizeof(T), storage.data(), &control);
+#else
+			handle = xQueueCreate(Length, sizeof(T));
+#endif
+			assert(handle != NULL);
+			return handle;
+		}
+
+		inline QueueHandle_t Handle() const { return handle; }
+
+	private:
+#if configSUPPORT_STATIC_ALLOCATION
+		StaticQueue_t control;
+		std::array<uint8_t, Length * sizeof(T)> storage;
+#endif
+		QueueHandle_t handle = NULL;
+	};
+
+#if configSUPPORT_STATIC_ALLOCATION
+	inline StaticTask_t idleTcb;
+	inline std::array<StackType_t, configMINIMAL_STACK_SIZE> idleStack;
+
+	// kernel objects the scheduler creates itself
+	constexpr uint32_t kernelRam = sizeof(idleTcb) + sizeof(idleStack);
+#endif
+}
+
+#if configSUPPORT_STATIC_ALLOCATION
+extern "C" void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer, uint32_t *pulIdleTaskStackSize) {
+	*ppxIdleTaskTCBBuffer = &Rtos::idleTcb;
+	*ppxIdleTaskStackBuffer = Rtos::idleStack.data();
+	*pulIdleTaskStackSize = Rtos::idleStack.size();
+}
+#endif
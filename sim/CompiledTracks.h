@@ -0,0 +1,30 @@
+#pragma once
+
+// Stand-in for the generated tracks header: the Playtune binaries are not
+// part of the sources, so every track is the same short two-voice phrase,
+// compiled by tools/playtunec from
+//   'P' 't' 6 0 0 2                header: length 6, two tone generators
+//   90 45 01 F4                    A4 on tonegen 0, 500 ms
+//   C1 28                          violin (a sawtooth) on tonegen 1
+//   91 49 01 F4                    C#5 on tonegen 1, 500 ms
+//   80 90 4C 00 FA                 E5 replaces A4, 250 ms
+//   80 81 00 C8                    rest 200 ms
+//   F0
+#include <Packed.hpp>
+
+static_assert(Tones::Packed::format == 2 && Tones::channels >= 8, "Packed.hpp changed, rerun tools/playtunec");
+
+namespace CompiledTracks
+{
+	constexpr uint8_t simTrack[] = {
+		0x00, 0x45, 0x0F, 0x49, 0xF4, 0x03, 0x04, 0x4C, 0xF4, 0x03, 0x44, 0xFA, 0x01, 0x48, 0xCC, 0xC8,
+		0x01, 0xC0,
+	};
+
+	constexpr const auto &imperial_march = simTrack;
+	constexpr const auto &main_theme = simTrack;
+	constexpr const auto &boulevard_of_broken_dreams = simTrack;
+	constexpr const auto &gravity_falls_soundtrack = simTrack;
+	constexpr const auto &super_mario = simTrack;
+	constexpr const auto &tetris = simTrack;
+}
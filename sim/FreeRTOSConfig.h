@@ -0,0 +1,112 @@
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+/*-----------------------------------------------------------
+ * Host simulation settings for the FreeRTOS POSIX port.
+ *
+ * One kernel tick is one virtual millisecond, exactly as on the board,
+ * but the port's tick timer fires SIM_SPEEDUP times faster than real time.
+ * pdMS_TO_TICKS is pinned to the board's 1 kHz tick so firmware timing
+ * is unchanged.
+ *----------------------------------------------------------*/
+
+#include <assert.h>
+
+#ifndef SIM_SPEEDUP
+#define SIM_SPEEDUP									10
+#endif
+
+#define configUSE_PREEMPTION		                1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION     0
+#define configUSE_TICKLESS_IDLE                     0
+#define configUSE_IDLE_HOOK			                0
+#define configUSE_TICK_HOOK			                0
+#define configCPU_CLOCK_HZ			                CLOCK
+#define configTICK_RATE_HZ			                ( ( TickType_t ) ( 1000 * SIM_SPEEDUP ) )
+#define pdMS_TO_TICKS( xTimeInMs )					( ( TickType_t ) ( xTimeInMs ) )
+#define configMAX_PRIORITIES		                5
+#define configMINIMAL_STACK_SIZE	                ( ( unsigned short ) 4096 )	/* pthread stacks, not board stacks */
+#define configMAX_TASK_NAME_LEN		                ( 16 )
+#ifdef TASK_STATS
+#define configUSE_TRACE_FACILITY	                1
+#else
+#define configUSE_TRACE_FACILITY	                0
+#endif
+#define configUSE_16_BIT_TICKS		                0
+#define configIDLE_SHOULD_YIELD		                1
+#define configUSE_TASK_NOTIFICATIONS                1
+#define configUSE_MUTEXES                           0
+#define configUSE_RECURSIVE_MUTEXES                 0
+#define configUSE_COUNTING_SEMAPHORES               0
+#define configQUEUE_REGISTRY_SIZE					0
+
+/* Memory allocation related definitions. */
+#ifdef STATIC_MEMORY
+/* As on the board: every kernel object is reserved by rtos.hpp, the
+Makefile leaves heap_4.c out. The stacks are pthread stacks, far beyond
+the board's, so main.cpp does not hold them to rtosRamBudget. */
+#define configSUPPORT_STATIC_ALLOCATION				1
+#define configSUPPORT_DYNAMIC_ALLOCATION			0
+#define configTOTAL_HEAP_SIZE		                ( ( size_t ) 0 )
+#define configHOST_STACKS							1
+#else
+#define configSUPPORT_STATIC_ALLOCATION				0
+#define configSUPPORT_DYNAMIC_ALLOCATION			1
+#define configTOTAL_HEAP_SIZE		                ( ( size_t ) ( 1024 * 1024 ) )
+#endif
+#define configAPPLICATION_ALLOCATED_HEAP			0
+#define configCHECK_FOR_STACK_OVERFLOW				0
+#define configUSE_MALLOC_FAILED_HOOK				0
+
+/* No software timers, so no timer daemon task: the turn clock is the RTC. */
+#define configUSE_TIMERS							0
+
+/* Co-routine definitions. */
+#define configUSE_CO_ROUTINES 		                0
+#define configMAX_CO_ROUTINE_PRIORITIES             ( 2 )
+
+#define INCLUDE_vTaskPrioritySet                    1
+#define INCLUDE_uxTaskPriorityGet                   1
+#define INCLUDE_vTaskDelete                         1
+#define INCLUDE_vTaskSuspend                        1
+#define INCLUDE_xResumeFromISR                      1
+#define INCLUDE_vTaskDelayUntil                     1
+#define INCLUDE_vTaskDelay                          1
+#define INCLUDE_xTaskGetSchedulerState              1
+#define INCLUDE_xTaskGetCurrentTaskHandle           1
+#ifdef TASK_STATS
+#define INCLUDE_uxTaskGetStackHighWaterMark         1
+#else
+#define INCLUDE_uxTaskGetStackHighWaterMark         0
+#endif
+#define INCLUDE_xTaskGetIdleTaskHandle              0
+#define INCLUDE_eTaskGetState                       0
+#define INCLUDE_xEventGroupSetBitFromISR            1
+#define INCLUDE_xTaskAbortDelay                     0
+#define INCLUDE_xTaskGetHandle                      0
+#define INCLUDE_xTaskResumeFromISR                  1
+
+/* Same run-time statistics hooks as the board, fed by the emulated TIM1. */
+#ifdef TASK_STATS
+#ifdef __cplusplus
+extern "C" {
+#endif
+void vConfigureTimerForRunTimeStats( void );
+unsigned long ulGetRunTimeCounterValue( void );
+#ifdef __cplusplus
+}
+#endif
+#define configGENERATE_RUN_TIME_STATS				1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()	vConfigureTimerForRunTimeStats()
+#define portGET_RUN_TIME_COUNTER_VALUE()			ulGetRunTimeCounterValue()
+#define traceTASK_SWITCHED_IN()						( pxCurrentTCB->uxTaskNumber++ )
+#else
+#define configGENERATE_RUN_TIME_STATS				0
+#endif
+
+/* Emulated interrupts run in the simulator task, so any priority is legal. */
+#define configLIBRARY_KERNEL_INTERRUPT_PRIORITY	15
+
+#define configASSERT( x ) assert( x )
+
+#endif /* FREERTOS_CONFIG_H */
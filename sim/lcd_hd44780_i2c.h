@@ -0,0 +1,3 @@
+#pragma once
+
+// the LCD driver is not used by the firmware yet, nothing to mock
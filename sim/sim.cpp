@@ -0,0 +1,656 @@
+// Host simulation of the TimeTracker board on the FreeRTOS POSIX port.
+//
+// A top priority task wakes once per tick (one virtual millisecond), applies
+// the scripted pin levels, advances the mocked peripherals and runs the
+// emulated interrupt handlers inside a critical section, so firmware tasks
+// see the same ordering as on the board. UART bytes go to stdout (or the
+// SIM_UART file), the trace goes to stderr.
+
+#include "stm32f1xx.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Sim
+{
+	// reset values: RCC_Init() spins on the ready flags
+	GPIO_TypeDef gpioA, gpioB, gpioC, gpioD;
+	AFIO_TypeDef afio;
+	EXTI_TypeDef exti;
+	RCC_TypeDef rcc = { RCC_CR_HSERDY | RCC_CR_PLLRDY, RCC_CFGR_SWS_PLL, 0, 0, 0, 0, 0, 0, RCC_BDCR_LSERDY };
+	FLASH_TypeDef flash = { 0, 0, 0, 0, { 0, &flash.AR } };
+	alignas(1024) uint8_t flashJournal[4 * 1024];
+	static const bool flashErased = (memset(flashJournal, 0xFF, sizeof(flashJournal)), true);   // before main() loads the journal
+	PWR_TypeDef pwr;
+	RTC_TypeDef rtc;
+	USART_TypeDef usart1 = { { USART_SR_TXE | USART_SR_TC }, { 0, &usart1.SR.flags } };
+	DMA_TypeDef dma1 = { 0, { &dma1.ISR } };
+	DMA_Channel_TypeDef dma1Channel[8];
+	TIM_TypeDef tim1, tim2, tim3, tim4;
+	SCB_Type scb;
+	DWT_Type dwt;
+	CoreDebug_Type coreDebug;
+}
+
+using namespace Sim;
+
+constexpr uint32_t sysclk = CLOCK;
+constexpr uint32_t cyclesPerTick = sysclk / 1000;
+
+#define SIM_HANDLER(name) extern "C" void name() __attribute__((weak));
+SIM_HANDLER(RTC_IRQHandler)
+SIM_HANDLER(EXTI0_IRQHandler)
+SIM_HANDLER(EXTI1_IRQHandler)
+SIM_HANDLER(EXTI2_IRQHandler)
+SIM_HANDLER(EXTI3_IRQHandler)
+SIM_HANDLER(EXTI4_IRQHandler)
+SIM_HANDLER(DMA1_Channel1_IRQHandler)
+SIM_HANDLER(DMA1_Channel2_IRQHandler)
+SIM_HANDLER(DMA1_Channel3_IRQHandler)
+SIM_HANDLER(DMA1_Channel4_IRQHandler)
+SIM_HANDLER(DMA1_Channel5_IRQHandler)
+SIM_HANDLER(DMA1_Channel6_IRQHandler)
+SIM_HANDLER(DMA1_Channel7_IRQHandler)
+SIM_HANDLER(EXTI9_5_IRQHandler)
+SIM_HANDLER(TIM1_UP_IRQHandler)
+SIM_HANDLER(TIM1_CC_IRQHandler)
+SIM_HANDLER(TIM2_IRQHandler)
+SIM_HANDLER(TIM3_IRQHandler)
+SIM_HANDLER(TIM4_IRQHandler)
+SIM_HANDLER(USART1_IRQHandler)
+SIM_HANDLER(EXTI15_10_IRQHandler)
+SIM_HANDLER(RTC_Alarm_IRQHandler)
+
+extern "C" void __real_vTaskStartScheduler(void);
+
+namespace
+{
+	struct Action {
+		enum Kind { Level, Note, Rx, Quit };
+		TickType_t time;
+		Kind kind;
+		GPIO_TypeDef *port;
+		uint8_t pin;
+		bool level;
+		std::string text;
+	};
+
+	struct TimerState {
+		uint64_t remainder = 0;   // prescaler input cycles carried to the next tick
+		uint64_t elapsed = 0;     // counts since boot
+		uint32_t updates = 0;     // update events in the last tick, each a DMA request with UDE
+		std::array<std::string, 4> tone;
+		// toggle mode: level and times of the last edges, in counts
+		std::array<bool, 4> level = {};
+		std::array<std::array<uint64_t, 2>, 4> edges = {};   // last rising, last falling
+		std::array<double, 4> frequency = {};                // as last logged
+	};
+
+	struct DmaState {
+		bool enabled = false;
+		uintptr_t memory = 0;
+		uint32_t total = 0;
+		uint32_t offset = 0;
+	};
+
+	std::array<void (*)(), IRQn_Count> vectors;
+	std::array<bool, IRQn_Count> enabled;
+	std::array<bool, IRQn_Count> pending;
+	std::array<uint32_t, IRQn_Count> irqCount;
+
+	std::array<GPIO_TypeDef*, 4> ports = { &gpioA, &gpioB, &gpioC, &gpioD };
+	std::array<uint32_t, 4> lastIdr;
+	std::array<TIM_TypeDef*, 4> timers = { &tim1, &tim2, &tim3, &tim4 };
+	std::array<TimerState, 4> timerState;   // same order
+	std::array<DmaState, 8> dmaState;
+	uint32_t uartCarry = 0;
+	uint32_t rxCarry = 0;
+	std::string rxPending;   // script input still to arrive on USART1 RX
+	uint64_t rtcCycles = 0;   // LSE cycles x1000 not yet counted
+
+	std::vector<Action> script;
+	size_t nextAction = 0;
+	TickType_t now = 0;
+	FILE *uart = stdout;
+	FILE *audio = nullptr;   // SIM_AUDIO: DMA-fed compare values, 16-bit raw
+	uint64_t uartBytes = 0;
+	uint64_t samples = 0;
+	uint32_t toneChanges = 0;
+	uint32_t pinEdges = 0;
+	std::chrono::steady_clock::time_point realStart;
+
+	void Log(const char *format, ...) {
+		va_list args;
+		va_start(args, format);
+		fprintf(stderr, "[%8u ms] ", (unsigned)now);
+		vfprintf(stderr, format, args);
+		fputc('\n', stderr);
+		va_end(args);
+	}
+
+	bool ParsePin(const std::string &name, GPIO_TypeDef *&port, uint8_t &pin) {
+		if (name.size() < 2 || name[0] < 'A' || name[0] > 'D')
+			return false;
+		port = ports[name[0] - 'A'];
+		pin = std::stoi(name.substr(1));
+		return pin < 16;
+	}
+
+	// <ms> press|release|high|low <pin|alias> [bounce <ms>]
+	// <ms> note <text>
+	// <ms> rx <text>          a line arriving on USART1 RX, LF appended
+	// <ms> quit
+	// alias <name> <pin>
+	void LoadScript(const char *path) {
+		std::ifstream file(path);
+		if (!file) {
+			fprintf(stderr, "sim: cannot open script '%s' (set SIM_SCRIPT)\n", path);
+			exit(1);
+		}
+
+		std::map<std::string, std::string> aliases;
+		std::string line;
+		unsigned lineNumber = 0;
+		while (std::getline(file, line)) {
+			lineNumber++;
+			std::istringstream in(line.substr(0, line.find('#')));
+			std::string first, verb;
+			if (!(in >> first))
+				continue;
+			if (first == "alias") {
+				std::string name, pin;
+				in >> name >> pin;
+				aliases[name] = pin;
+				continue;
+			}
+
+			Action action = {};
+			action.time = std::stoul(first);
+			in >> verb;
+			if (verb == "quit") {
+				action.kind = Action::Quit;
+				script.push_back(action);
+				continue;
+			}
+			if (verb == "note" || verb == "rx") {
+				action.kind = verb == "rx" ? Action::Rx : Action::Note;
+				std::getline(in >> std::ws, action.text);
+				script.push_back(action);
+				continue;
+			}
+
+			std::string pinName, option;
+			uint32_t bounce = 0;
+			in >> pinName;
+			if (in >> option && option == "bounce")
+				in >> bounce;
+			if (aliases.count(pinName))
+				pinName = aliases[pinName];
+			action.kind = Action::Level;
+			action.level = (verb == "press" || verb == "high");
+			if ((verb != "press" && verb != "release" && verb != "high" && verb != "low")
+				|| !ParsePin(pinName, action.port, action.pin)) {
+				fprintf(stderr, "sim: %s:%u: cannot parse '%s'\n", path, lineNumber, line.c_str());
+				exit(1);
+			}
+			action.text = pinName;
+
+			// contact bounce: alternate every tick before settling on the final level
+			for (uint32_t i = 0; i < bounce; i++) {
+				Action glitch = action;
+				glitch.time = action.time + i;
+				glitch.level = (i % 2 == 0) == action.level;
+				script.push_back(glitch);
+			}
+			action.time += bounce;
+			script.push_back(action);
+		}
+		std::stable_sort(script.begin(), script.end(), [](const Action &a, const Action &b) { return a.time < b.time; });
+	}
+
+	void Summary() {
+		auto real = std::chrono::duration<double>(std::chrono::steady_clock::now() - realStart).count();
+		Log("done: %.3f s virtual in %.3f s real (x%.1f)", now / 1000.0, real, real > 0 ? now / 1000.0 / real : 0.0);
+		fprintf(stderr, "  pin edges %u, tone changes %u, uart bytes %llu, dac samples %llu\n", pinEdges, toneChanges,
+			(unsigned long long)uartBytes, (unsigned long long)samples);
+		for (int irq = 0; irq < IRQn_Count; irq++) {
+			if (irqCount[irq])
+				fprintf(stderr, "  irq %2d: %u\n", irq, irqCount[irq]);
+		}
+	}
+
+	void RunScript() {
+		while (nextAction < script.size() && script[nextAction].time <= now) {
+			auto &action = script[nextAction++];
+			switch (action.kind) {
+			case Action::Level:
+				if (action.level)
+					action.port->IDR |= (1U << action.pin);
+				else
+					action.port->IDR &= ~(1U << action.pin);
+				break;
+			case Action::Note:
+				Log("note %s", action.text.c_str());
+				break;
+			case Action::Rx:
+				Log("rx %s", action.text.c_str());
+				rxPending += action.text + "\n";
+				break;
+			case Action::Quit:
+				Summary();
+				fflush(uart);
+				if (audio)
+					fflush(audio);
+				fflush(stderr);
+				_Exit(0);
+			}
+		}
+	}
+
+	void StepExti() {
+		for (uint32_t p = 0; p < ports.size(); p++) {
+			uint32_t idr = ports[p]->IDR & 0xFFFF;
+			uint32_t changed = idr ^ lastIdr[p];
+			lastIdr[p] = idr;
+			for (uint32_t line = 0; line < 16; line++) {
+				uint32_t bit = 1U << line;
+				if (!(changed & bit))
+					continue;
+				pinEdges++;
+				bool routed = ((afio.EXTICR[line / 4] >> (4 * (line % 4))) & 0xF) == p;
+				bool edge = (idr & bit) ? (exti.RTSR & bit) : (exti.FTSR & bit);
+				if (routed && edge && (exti.IMR & bit))
+					exti.PR.flags |= bit;
+			}
+		}
+	}
+
+	enum OutputMode : uint32_t { toggle = 3, forceLow = 4, pwm1 = 6, pwm2 = 7 };
+
+	OutputMode Mode(const TIM_TypeDef &tim, int ch) {
+		return OutputMode(((ch < 2 ? tim.CCMR1 : tim.CCMR2) >> (4 + 8 * (ch % 2))) & 7);
+	}
+
+	void LogTone(const char *name, int ch, TimerState &state, const std::string &tone) {
+		if (tone == state.tone[ch])
+			return;
+		Log("%s.%d %s", name, ch + 1, tone.c_str());
+		state.tone[ch] = tone;
+		toneChanges++;
+	}
+
+	// A toggle-mode edge at 'time': a full period after the previous edge in
+	// the same direction the pitch is known. Logged when it moves by more
+	// than 0.5 %, less is the fraction carrying over.
+	void ToggleEdge(const char *name, TIM_TypeDef &tim, TimerState &state, int ch, uint64_t time) {
+		bool rising = !state.level[ch];
+		state.level[ch] = rising;
+		uint64_t previous = state.edges[ch][rising ? 0 : 1];
+		state.edges[ch][rising ? 0 : 1] = time;
+		if (!rising || !previous)
+			return;
+		double counts = (double)(time - previous);
+		double frequency = (double)sysclk / (tim.PSC + 1.0) / counts;
+		if (std::abs(frequency - state.frequency[ch]) <= frequency / 200)
+			return;
+		state.frequency[ch] = frequency;
+		char text[48];
+		snprintf(text, sizeof(text), "%.1f Hz %u%%", frequency, (unsigned)(100 * (double)(state.edges[ch][1] - previous) / counts));
+		LogTone(name, ch, state, text);
+	}
+
+	// 'irq' runs for every toggle-mode compare match as it happens, so a
+	// handler that sets the next edge gets called many times a tick
+	void StepTimer(const char *name, TIM_TypeDef &tim, TimerState &state, IRQn_Type irq = IRQn_Count) {
+		if (tim.EGR & TIM_EGR_UG) {
+			tim.CNT = 0;
+			tim.EGR = 0;
+		}
+
+		// log audible PWM outputs as tones; toggle mode logs from its edges,
+		// a DMA-fed compare is a DAC (SIM_AUDIO)
+		const volatile uint32_t *ccr[] = { &tim.CCR1, &tim.CCR2, &tim.CCR3, &tim.CCR4 };
+		std::array<bool, 4> toggling = {};
+		for (int ch = 0; ch < 4; ch++) {
+			bool output = (tim.CR1 & TIM_CR1_CEN) && (tim.CCER & (TIM_CCER_CC1E << (4 * ch)));
+			OutputMode mode = Mode(tim, ch);
+			toggling[ch] = output && mode == toggle && irq != IRQn_Count && (tim.DIER & (TIM_DIER_CC1IE << ch));
+			if (toggling[ch])
+				continue;
+			state.level[ch] = false;
+			state.edges[ch] = {};
+			state.frequency[ch] = 0;
+			std::string tone = "off";
+			double frequency = (double)sysclk / ((tim.PSC + 1.0) * (tim.ARR + 1.0));
+			if (output && (mode == pwm1 || mode == pwm2) && *ccr[ch] != 0 && frequency < 20000 && !(tim.DIER & TIM_DIER_UDE)) {
+				char text[48];
+				snprintf(text, sizeof(text), "%.1f Hz %u%%", frequency, (unsigned)(100 * *ccr[ch] / (tim.ARR + 1)));
+				tone = text;
+			}
+			if (output || !state.tone[ch].empty())
+				LogTone(name, ch, state, tone);
+		}
+
+		state.updates = 0;
+		if (!(tim.CR1 & TIM_CR1_CEN))
+			return;
+		uint64_t input = cyclesPerTick + state.remainder;
+		uint64_t counts = input / (tim.PSC + 1);
+		state.remainder = input % (tim.PSC + 1);
+		uint64_t period = (uint64_t)tim.ARR + 1;
+		uint64_t from = tim.CNT;
+		uint64_t to = from + counts;
+
+		// toggle-mode matches in order, each handled before the next is found
+		for (uint64_t at = from; irq != IRQn_Count && enabled[irq] && vectors[irq]; ) {
+			int next = -1;
+			uint64_t nextAt = 0;
+			for (int ch = 0; ch < 4; ch++) {
+				if (!toggling[ch] || !(tim.DIER & (TIM_DIER_CC1IE << ch)) || *ccr[ch] >= period)
+					continue;
+				uint64_t distance = (*ccr[ch] + period - at % period) % period;
+				uint64_t when = at + (distance ? distance : period);
+				if (when <= to && (next < 0 || when < nextAt)) {
+					next = ch;
+					nextAt = when;
+				}
+			}
+			if (next < 0)
+				break;
+			at = nextAt;
+			tim.CNT = at % period;
+			tim.SR.flags |= (TIM_SR_CC1IF << next);
+			ToggleEdge(name, tim, state, next, state.elapsed + (at - from));
+			irqCount[irq]++;
+			vectors[irq]();
+		}
+
+		for (int ch = 0; ch < 4; ch++) {
+			uint64_t match = *ccr[ch];
+			if (match >= period || toggling[ch])
+				continue;
+			if (counts >= period || (match > from && match <= to) || (match + period > from && match + period <= to))
+				tim.SR.flags |= (TIM_SR_CC1IF << ch);
+		}
+		state.updates = to / period;
+		if (to >= period) {
+			tim.SR.flags |= TIM_SR_UIF;
+			if (tim.CR1 & TIM_CR1_OPM)
+				tim.CR1 &= ~TIM_CR1_CEN;
+		}
+		tim.CNT = to % period;
+		state.elapsed += counts;
+	}
+
+	// 32768 LSE cycles per 1000 virtual ms, divided by PRL + 1
+	void StepRtc() {
+		if (!(rcc.BDCR & RCC_BDCR_RTCEN))
+			return;
+		uint64_t divider = ((((uint64_t)rtc.PRLH & 0xF) << 16 | rtc.PRLL) + 1) * 1000;
+		rtcCycles += 32768;
+		while (rtcCycles >= divider) {
+			rtcCycles -= divider;
+			uint32_t count = ((rtc.CNTH << 16) | rtc.CNTL) + 1;
+			rtc.CNTH = count >> 16;
+			rtc.CNTL = count & 0xFFFF;
+			if (count == ((rtc.ALRH << 16) | rtc.ALRL)) {
+				rtc.CRL |= RTC_CRL_ALRF;
+				if (exti.IMR & exti.RTSR & (1U << 17))
+					exti.PR.flags |= 1U << 17;
+			}
+		}
+	}
+
+	// the timer whose compare registers 'address' is in, or -1
+	int CompareOf(uintptr_t address) {
+		for (uint32_t t = 0; t < timers.size(); t++) {
+			if (address >= (uintptr_t)&timers[t]->CCR1 && address <= (uintptr_t)&timers[t]->CCR4)
+				return t;
+		}
+		return -1;
+	}
+
+	void StepDma() {
+		for (uint32_t n = 1; n < dmaState.size(); n++) {
+			auto &channel = dma1Channel[n];
+			auto &state = dmaState[n];
+			bool on = channel.CCR & DMA_CCR_EN;
+			// an ISR may disable and re-arm a channel between two steps
+			bool rearmed = channel.CMAR != state.memory || channel.CNDTR != state.total - state.offset;
+			if (on && (!state.enabled || rearmed)) {
+				state.memory = channel.CMAR;
+				state.total = channel.CNDTR;
+				state.offset = 0;
+			}
+			state.enabled = on;
+			if (!on || channel.CNDTR == 0)
+				continue;
+
+			// memory -> USART1 at line rate
+			if ((channel.CCR & DMA_CCR_DIR) && channel.CPAR == (uintptr_t)&usart1.DR
+				&& (usart1.CR3 & USART_CR3_DMAT) && (usart1.CR1 & USART_CR1_TE) && usart1.BRR) {
+				uint32_t rate = sysclk / usart1.BRR / 10 + uartCarry;   // bytes per second, 10 bits each
+				uint32_t budget = rate / 1000;
+				uartCarry = rate % 1000;
+				uint32_t count = std::min(budget, (uint32_t)channel.CNDTR);
+				auto memory = reinterpret_cast<const uint8_t*>(channel.CMAR);
+				fwrite(memory + state.offset, 1, count, uart);
+				uartBytes += count;
+				state.offset += count;
+				channel.CNDTR -= count;
+				usart1.SR.flags &= ~USART_SR_TC;
+
+				uint32_t shift = 4 * (n - 1);
+				if (state.offset >= state.total / 2 && state.offset - count < state.total / 2)
+					dma1.ISR |= (DMA_ISR_GIF1 | DMA_ISR_HTIF1) << shift;
+				if (channel.CNDTR == 0) {
+					dma1.ISR |= (DMA_ISR_GIF1 | DMA_ISR_TCIF1) << shift;
+					usart1.SR.flags |= USART_SR_TC | USART_SR_TXE;
+					if (channel.CCR & DMA_CCR_CIRC) {
+						channel.CNDTR = state.total;
+						state.offset = 0;
+					}
+				}
+			}
+
+			// USART1 -> memory at line rate; the line goes idle once the input is used up
+			if (!(channel.CCR & DMA_CCR_DIR) && channel.CPAR == (uintptr_t)&usart1.DR
+				&& (usart1.CR3 & USART_CR3_DMAR) && (usart1.CR1 & USART_CR1_RE) && usart1.BRR && !rxPending.empty()) {
+				uint32_t rate = sysclk / usart1.BRR / 10 + rxCarry;
+				uint32_t budget = rate / 1000;
+				rxCarry = rate % 1000;
+				uint32_t shift = 4 * (n - 1);
+				auto memory = reinterpret_cast<uint8_t*>(channel.CMAR);
+				for (uint32_t i = 0; i < budget && !rxPending.empty() && channel.CNDTR; i++) {
+					memory[state.offset++] = rxPending.front();
+					rxPending.erase(0, 1);
+					channel.CNDTR--;
+					if (state.offset == state.total / 2)
+						dma1.ISR |= (DMA_ISR_GIF1 | DMA_ISR_HTIF1) << shift;
+					if (channel.CNDTR == 0) {
+						dma1.ISR |= (DMA_ISR_GIF1 | DMA_ISR_TCIF1) << shift;
+						if (channel.CCR & DMA_CCR_CIRC) {
+							channel.CNDTR = state.total;
+							state.offset = 0;
+						}
+					}
+				}
+				if (rxPending.empty())
+					usart1.SR.flags |= USART_SR_IDLE;
+			}
+
+			// memory -> timer compare, one 16-bit sample per update event
+			int timer = CompareOf(channel.CPAR);
+			if ((channel.CCR & DMA_CCR_DIR) && timer >= 0 && (timers[timer]->DIER & TIM_DIER_UDE)) {
+				uint32_t shift = 4 * (n - 1);
+				auto memory = reinterpret_cast<const uint16_t*>(channel.CMAR);
+				for (uint32_t i = 0; i < timerState[timer].updates && channel.CNDTR; i++) {
+					uint16_t sample = memory[state.offset++];
+					*reinterpret_cast<volatile uint32_t*>(channel.CPAR) = sample;
+					if (audio)
+						fwrite(&sample, sizeof(sample), 1, audio);
+					samples++;
+					channel.CNDTR--;
+					if (state.offset == state.total / 2)
+						dma1.ISR |= (DMA_ISR_GIF1 | DMA_ISR_HTIF1) << shift;
+					if (channel.CNDTR == 0) {
+						dma1.ISR |= (DMA_ISR_GIF1 | DMA_ISR_TCIF1) << shift;
+						if (channel.CCR & DMA_CCR_CIRC) {
+							channel.CNDTR = state.total;
+							state.offset = 0;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	bool Level(int irq) {
+		switch (irq) {
+		case EXTI0_IRQn: case EXTI1_IRQn: case EXTI2_IRQn: case EXTI3_IRQn: case EXTI4_IRQn:
+			return exti.PR & exti.IMR & (1U << (irq - EXTI0_IRQn));
+		case EXTI9_5_IRQn:
+			return exti.PR & exti.IMR & 0x03E0;
+		case EXTI15_10_IRQn:
+			return exti.PR & exti.IMR & 0xFC00;
+		case DMA1_Channel1_IRQn: case DMA1_Channel2_IRQn: case DMA1_Channel3_IRQn: case DMA1_Channel4_IRQn:
+		case DMA1_Channel5_IRQn: case DMA1_Channel6_IRQn: case DMA1_Channel7_IRQn: {
+				uint32_t n = irq - DMA1_Channel1_IRQn + 1;
+				return (dma1.ISR >> (4 * (n - 1))) & dma1Channel[n].CCR & (DMA_CCR_TCIE | DMA_CCR_HTIE | DMA_CCR_TEIE);
+			}
+		case RTC_Alarm_IRQn:
+			return exti.PR & exti.IMR & (1U << 17);
+		case TIM1_UP_IRQn:
+			return tim1.SR & tim1.DIER & TIM_SR_UIF;
+		case TIM1_CC_IRQn:
+			return tim1.SR & tim1.DIER & (TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC3IF | TIM_SR_CC4IF);
+		case TIM2_IRQn:
+			return tim2.SR & tim2.DIER & 0x1F;
+		case TIM3_IRQn:
+			return tim3.SR & tim3.DIER & 0x1F;
+		case TIM4_IRQn:
+			return tim4.SR & tim4.DIER & 0x1F;
+		case USART1_IRQn:
+			return usart1.SR & usart1.CR1 & (USART_SR_TXE | USART_SR_TC | USART_SR_RXNE | USART_SR_IDLE);
+		default:
+			return false;
+		}
+	}
+
+	void Dispatch() {
+		for (int irq = 0; irq < IRQn_Count; irq++) {
+			// a handler that never clears its source would hang the board, cap it here
+			for (int guard = 0; guard < 16 && enabled[irq] && vectors[irq] && (pending[irq] || Level(irq)); guard++) {
+				pending[irq] = false;
+				irqCount[irq]++;
+				vectors[irq]();
+			}
+		}
+	}
+
+	void vTaskSimulator(void *parameter) {
+		TickType_t xLastWakeTime = xTaskGetTickCount();
+		while (1)
+		{
+			vTaskDelayUntil(&xLastWakeTime, 1);
+			now = xLastWakeTime;
+
+			taskENTER_CRITICAL();
+			RunScript();
+			StepExti();
+			StepTimer("TIM1", tim1, timerState[0]);
+			StepTimer("TIM2", tim2, timerState[1], TIM2_IRQn);
+			StepTimer("TIM3", tim3, timerState[2], TIM3_IRQn);
+			StepTimer("TIM4", tim4, timerState[3], TIM4_IRQn);
+			StepRtc();
+			StepDma();
+			if (dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk)
+				dwt.CYCCNT += cyclesPerTick;
+			Dispatch();
+			taskEXIT_CRITICAL();
+		}
+	}
+}
+
+void NVIC_EnableIRQ(IRQn_Type irq) { enabled[irq] = true; }
+void NVIC_DisableIRQ(IRQn_Type irq) { enabled[irq] = false; }
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority) {}
+void NVIC_SetPendingIRQ(IRQn_Type irq) { pending[irq] = true; }
+void NVIC_ClearPendingIRQ(IRQn_Type irq) { pending[irq] = false; }
+
+void NVIC_SystemReset() {
+	Log("system reset");
+	Summary();
+	fflush(uart);
+	if (audio)
+		fflush(audio);
+	_Exit(2);
+}
+
+// main() belongs to the firmware; the simulator joins in right before the
+// scheduler starts (linked with -Wl,--wrap=vTaskStartScheduler)
+extern "C" void __wrap_vTaskStartScheduler(void) {
+	vectors[RTC_IRQn] = RTC_IRQHandler;
+	vectors[EXTI0_IRQn] = EXTI0_IRQHandler;
+	vectors[EXTI1_IRQn] = EXTI1_IRQHandler;
+	vectors[EXTI2_IRQn] = EXTI2_IRQHandler;
+	vectors[EXTI3_IRQn] = EXTI3_IRQHandler;
+	vectors[EXTI4_IRQn] = EXTI4_IRQHandler;
+	vectors[DMA1_Channel1_IRQn] = DMA1_Channel1_IRQHandler;
+	vectors[DMA1_Channel2_IRQn] = DMA1_Channel2_IRQHandler;
+	vectors[DMA1_Channel3_IRQn] = DMA1_Channel3_IRQHandler;
+	vectors[DMA1_Channel4_IRQn] = DMA1_Channel4_IRQHandler;
+	vectors[DMA1_Channel5_IRQn] = DMA1_Channel5_IRQHandler;
+	vectors[DMA1_Channel6_IRQn] = DMA1_Channel6_IRQHandler;
+	vectors[DMA1_Channel7_IRQn] = DMA1_Channel7_IRQHandler;
+	vectors[EXTI9_5_IRQn] = EXTI9_5_IRQHandler;
+	vectors[TIM1_UP_IRQn] = TIM1_UP_IRQHandler;
+	vectors[TIM1_CC_IRQn] = TIM1_CC_IRQHandler;
+	vectors[TIM2_IRQn] = TIM2_IRQHandler;
+	vectors[TIM3_IRQn] = TIM3_IRQHandler;
+	vectors[TIM4_IRQn] = TIM4_IRQHandler;
+	vectors[USART1_IRQn] = USART1_IRQHandler;
+	vectors[EXTI15_10_IRQn] = EXTI15_10_IRQHandler;
+	vectors[RTC_Alarm_IRQn] = RTC_Alarm_IRQHandler;
+
+	const char *path = getenv("SIM_SCRIPT");
+	LoadScript(path ? path : "scenario.txt");
+	if (const char *out = getenv("SIM_UART")) {
+		uart = fopen(out, "wb");
+		if (!uart) {
+			fprintf(stderr, "sim: cannot open '%s'\n", out);
+			exit(1);
+		}
+	}
+	if (const char *out = getenv("SIM_AUDIO")) {
+		audio = fopen(out, "wb");
+		if (!audio) {
+			fprintf(stderr, "sim: cannot open '%s'\n", out);
+			exit(1);
+		}
+	}
+	for (uint32_t p = 0; p < ports.size(); p++)
+		lastIdr[p] = ports[p]->IDR & 0xFFFF;
+
+	realStart = std::chrono::steady_clock::now();
+#if configSUPPORT_DYNAMIC_ALLOCATION
+	xTaskCreate(vTaskSimulator, "Sim", configMINIMAL_STACK_SIZE, NULL, configMAX_PRIORITIES - 1, NULL);
+#else
+	static StaticTask_t tcb;
+	static std::array<StackType_t, configMINIMAL_STACK_SIZE> stack;
+	xTaskCreateStatic(vTaskSimulator, "Sim", stack.size(), NULL, configMAX_PRIORITIES - 1, stack.data(), &tcb);
+#endif
+	__real_vTaskStartScheduler();
+}
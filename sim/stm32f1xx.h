@@ -0,0 +1,382 @@
+#pragma once
+
+// Register-level mock of the STM32F103 peripherals used by the firmware.
+// Layouts and bit names follow CMSIS; address registers are pointer sized
+// so periph.hpp can store host pointers in them. sim.cpp owns the instances
+// and advances them once per virtual millisecond.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+#define __IO volatile
+#define __I volatile const
+
+namespace Sim
+{
+	// rc_w1 flags (EXTI_PR): reads return the flags, writing 1 clears them
+	struct ClearOnWrite1 {
+		volatile uint32_t flags;
+		inline operator uint32_t() const { return flags; }
+		inline ClearOnWrite1 &operator=(uint32_t value) { flags &= ~value; return *this; }
+		inline ClearOnWrite1 &operator|=(uint32_t value) { flags &= ~(flags | value); return *this; }
+	};
+
+	// rc_w0 flags (TIMx_SR, USART_SR): writing 0 clears, writing 1 has no effect
+	struct ClearOnWrite0 {
+		volatile uint32_t flags;
+		inline operator uint32_t() const { return flags; }
+		inline ClearOnWrite0 &operator=(uint32_t value) { flags &= value; return *this; }
+		inline ClearOnWrite0 &operator&=(uint32_t value) { flags &= value; return *this; }
+	};
+
+	// status bits the emulation never has to wait for (RTC_CRL: RTOFF, RSF)
+	template<uint32_t Set>
+	struct AlwaysSet {
+		volatile uint32_t value;
+		inline operator uint32_t() const { return value | Set; }
+		inline AlwaysSet &operator=(uint32_t v) { value = v; return *this; }
+		inline AlwaysSet &operator|=(uint32_t v) { value |= v; return *this; }
+		inline AlwaysSet &operator&=(uint32_t v) { value &= v; return *this; }
+	};
+
+	// FLASH_CR: programming completes at once; PER + STRT erases the page at AR
+	struct FlashControl {
+		volatile uint32_t bits;
+		volatile uintptr_t *address;
+		inline operator uint32_t() const { return bits; }
+		inline FlashControl &operator=(uint32_t value) { bits = value; Start(); return *this; }
+		inline FlashControl &operator|=(uint32_t value) { bits |= value; Start(); return *this; }
+		inline FlashControl &operator&=(uint32_t value) { bits &= value; return *this; }
+		inline void Start() {
+			if ((bits & 0x42) == 0x42) {   // PER | STRT
+				memset(reinterpret_cast<void*>(*address & ~uintptr_t(1023)), 0xFF, 1024);
+				bits &= ~0x40U;
+			}
+		}
+	};
+
+	// USART_DR: a read completes the SR-then-DR sequence that clears IDLE and RXNE
+	struct DataRegister {
+		volatile uint32_t value;
+		volatile uint32_t *status;
+		inline operator uint32_t() const { *status &= ~0x30U; return value; }
+		inline DataRegister &operator=(uint32_t v) { value = v; return *this; }
+	};
+
+	// write-only clear register (DMA_IFCR) acting on the ISR next to it
+	struct FlagClear {
+		volatile uint32_t *target;
+		inline operator uint32_t() const { return 0; }
+		inline FlagClear &operator=(uint32_t value) { *target &= ~value; return *this; }
+		inline FlagClear &operator|=(uint32_t value) { *target &= ~value; return *this; }
+	};
+}
+
+struct GPIO_TypeDef { __IO uint32_t CRL, CRH, IDR, ODR, BSRR, BRR, LCKR; };
+struct AFIO_TypeDef { __IO uint32_t EVCR, MAPR, EXTICR[4], RESERVED0, MAPR2; };
+struct EXTI_TypeDef { __IO uint32_t IMR, EMR, RTSR, FTSR, SWIER; Sim::ClearOnWrite1 PR; };
+struct RCC_TypeDef { __IO uint32_t CR, CFGR, CIR, APB2RSTR, APB1RSTR, AHBENR, APB2ENR, APB1ENR, BDCR, CSR; };
+struct FLASH_TypeDef { __IO uint32_t ACR, KEYR, OPTKEYR, SR; Sim::FlashControl CR; __IO uintptr_t AR; __IO uint32_t RESERVED, OBR, WRPR; };
+struct PWR_TypeDef { __IO uint32_t CR, CSR; };
+struct RTC_TypeDef { __IO uint32_t CRH; Sim::AlwaysSet<0x28> CRL; __IO uint32_t PRLH, PRLL, DIVH, DIVL, CNTH, CNTL, ALRH, ALRL; };
+struct USART_TypeDef { Sim::ClearOnWrite0 SR; Sim::DataRegister DR; __IO uint32_t BRR, CR1, CR2, CR3, GTPR; };
+struct DMA_Channel_TypeDef { __IO uint32_t CCR, CNDTR; __IO uintptr_t CPAR, CMAR; };
+struct DMA_TypeDef { __IO uint32_t ISR; Sim::FlagClear IFCR; };
+struct TIM_TypeDef {
+	__IO uint32_t CR1, CR2, SMCR, DIER;
+	Sim::ClearOnWrite0 SR;
+	__IO uint32_t EGR, CCMR1, CCMR2, CCER, CNT, PSC, ARR, RCR, CCR1, CCR2, CCR3, CCR4, BDTR, DCR, DMAR;
+};
+struct SCB_Type { __IO uint32_t CPUID, ICSR, VTOR, AIRCR, SCR, CCR; };
+struct DWT_Type { __IO uint32_t CTRL, CYCCNT; };
+struct CoreDebug_Type { __IO uint32_t DHCSR, DCRSR, DCRDR, DEMCR; };
+
+namespace Sim
+{
+	extern GPIO_TypeDef gpioA, gpioB, gpioC, gpioD;
+	extern AFIO_TypeDef afio;
+	extern EXTI_TypeDef exti;
+	extern RCC_TypeDef rcc;
+	extern FLASH_TypeDef flash;
+	extern uint8_t flashJournal[4 * 1024];   // stands in for the top flash pages
+	extern PWR_TypeDef pwr;
+	extern RTC_TypeDef rtc;
+	extern USART_TypeDef usart1;
+	extern DMA_TypeDef dma1;
+	extern DMA_Channel_TypeDef dma1Channel[8];   // [1..7] as in the reference manual
+	extern TIM_TypeDef tim1, tim2, tim3, tim4;
+	extern SCB_Type scb;
+	extern DWT_Type dwt;
+	extern CoreDebug_Type coreDebug;
+}
+
+#define GPIOA (&Sim::gpioA)
+#define GPIOB (&Sim::gpioB)
+#define GPIOC (&Sim::gpioC)
+#define GPIOD (&Sim::gpioD)
+#define AFIO (&Sim::afio)
+#define EXTI (&Sim::exti)
+#define RCC (&Sim::rcc)
+#define FLASH (&Sim::flash)
+#define FLASH_JOURNAL_BASE ((uintptr_t)Sim::flashJournal)
+#define PWR (&Sim::pwr)
+#define RTC (&Sim::rtc)
+#define USART1 (&Sim::usart1)
+#define DMA1 (&Sim::dma1)
+#define DMA1_Channel1 (&Sim::dma1Channel[1])
+#define DMA1_Channel2 (&Sim::dma1Channel[2])
+#define DMA1_Channel3 (&Sim::dma1Channel[3])
+#define DMA1_Channel4 (&Sim::dma1Channel[4])
+#define DMA1_Channel5 (&Sim::dma1Channel[5])
+#define DMA1_Channel6 (&Sim::dma1Channel[6])
+#define DMA1_Channel7 (&Sim::dma1Channel[7])
+#define TIM1 (&Sim::tim1)
+#define TIM2 (&Sim::tim2)
+#define TIM3 (&Sim::tim3)
+#define TIM4 (&Sim::tim4)
+#define SCB (&Sim::scb)
+#define DWT (&Sim::dwt)
+#define CoreDebug (&Sim::coreDebug)
+
+typedef enum {
+	RTC_IRQn = 3,
+	EXTI0_IRQn = 6,
+	EXTI1_IRQn = 7,
+	EXTI2_IRQn = 8,
+	EXTI3_IRQn = 9,
+	EXTI4_IRQn = 10,
+	DMA1_Channel1_IRQn = 11,
+	DMA1_Channel2_IRQn = 12,
+	DMA1_Channel3_IRQn = 13,
+	DMA1_Channel4_IRQn = 14,
+	DMA1_Channel5_IRQn = 15,
+	DMA1_Channel6_IRQn = 16,
+	DMA1_Channel7_IRQn = 17,
+	EXTI9_5_IRQn = 23,
+	TIM1_UP_IRQn = 25,
+	TIM1_CC_IRQn = 27,
+	TIM2_IRQn = 28,
+	TIM3_IRQn = 29,
+	TIM4_IRQn = 30,
+	USART1_IRQn = 37,
+	EXTI15_10_IRQn = 40,
+	RTC_Alarm_IRQn = 41,
+	IRQn_Count = 43
+} IRQn_Type;
+
+void NVIC_EnableIRQ(IRQn_Type irq);
+void NVIC_DisableIRQ(IRQn_Type irq);
+void NVIC_SetPriority(IRQn_Type irq, uint32_t priority);
+void NVIC_SetPendingIRQ(IRQn_Type irq);
+void NVIC_ClearPendingIRQ(IRQn_Type irq);
+void NVIC_SystemReset();
+
+inline void __NOP() {}
+inline void __WFI() {}
+inline void __WFE() {}
+inline void __SEV() {}
+inline void __DSB() { std::atomic_thread_fence(std::memory_order_seq_cst); }
+inline void __ISB() { std::atomic_thread_fence(std::memory_order_seq_cst); }
+inline void __DMB() { std::atomic_thread_fence(std::memory_order_seq_cst); }
+
+#define FLASH_BASE 0x08000000UL
+
+/* RCC */
+#define RCC_CR_HSEON 0x00010000U
+#define RCC_CR_HSERDY 0x00020000U
+#define RCC_CR_PLLON 0x01000000U
+#define RCC_CR_PLLRDY 0x02000000U
+#define RCC_CFGR_SW 0x00000003U
+#define RCC_CFGR_SW_PLL 0x00000002U
+#define RCC_CFGR_SWS 0x0000000CU
+#define RCC_CFGR_SWS_PLL 0x00000008U
+#define RCC_CFGR_HPRE_DIV1 0x00000000U
+#define RCC_CFGR_HPRE_DIV2 0x00000080U
+#define RCC_CFGR_HPRE_DIV4 0x00000090U
+#define RCC_CFGR_PPRE1_DIV1 0x00000000U
+#define RCC_CFGR_PPRE1_DIV2 0x00000400U
+#define RCC_CFGR_PPRE1_DIV4 0x00000500U
+#define RCC_CFGR_PPRE2_DIV1 0x00000000U
+#define RCC_CFGR_PPRE2_DIV2 0x00002000U
+#define RCC_CFGR_PPRE2_DIV4 0x00002800U
+#define RCC_CFGR_PLLSRC 0x00010000U
+#define RCC_CFGR_PLLXTPRE 0x00020000U
+#define RCC_CFGR_PLLMULL 0x003C0000U
+#define RCC_CFGR_PLLMULL9 0x001C0000U
+#define RCC_CFGR_MCO_PLLCLK_DIV2 0x07000000U
+#define RCC_AHBENR_DMA1EN 0x00000001U
+#define RCC_AHBENR_FLITFEN 0x00000010U
+#define RCC_APB2ENR_AFIOEN 0x00000001U
+#define RCC_APB2ENR_IOPAEN 0x00000004U
+#define RCC_APB2ENR_IOPBEN 0x00000008U
+#define RCC_APB2ENR_IOPCEN 0x00000010U
+#define RCC_APB2ENR_IOPDEN 0x00000020U
+#define RCC_APB2ENR_TIM1EN 0x00000800U
+#define RCC_APB2ENR_USART1EN 0x00004000U
+#define RCC_APB1ENR_TIM2EN 0x00000001U
+#define RCC_APB1ENR_TIM3EN 0x00000002U
+#define RCC_APB1ENR_TIM4EN 0x00000004U
+#define RCC_APB1ENR_BKPEN 0x08000000U
+#define RCC_APB1ENR_PWREN 0x10000000U
+#define RCC_BDCR_LSEON 0x00000001U
+#define RCC_BDCR_LSERDY 0x00000002U
+#define RCC_BDCR_RTCSEL 0x00000300U
+#define RCC_BDCR_RTCSEL_LSE 0x00000100U
+#define RCC_BDCR_RTCSEL_LSI 0x00000200U
+#define RCC_BDCR_RTCEN 0x00008000U
+#define RCC_BDCR_BDRST 0x00010000U
+#define RCC_CSR_LSION 0x00000001U
+#define RCC_CSR_LSIRDY 0x00000002U
+
+/* PWR */
+#define PWR_CR_LPDS 0x00000001U
+#define PWR_CR_PDDS 0x00000002U
+#define PWR_CR_CWUF 0x00000004U
+#define PWR_CR_DBP 0x00000100U
+
+/* FLASH */
+#define FLASH_ACR_LATENCY_2 0x00000002U
+#define FLASH_ACR_PRFTBE 0x00000010U
+#define FLASH_KEY1 0x45670123U
+#define FLASH_KEY2 0xCDEF89ABU
+#define FLASH_SR_BSY 0x00000001U
+#define FLASH_SR_PGERR 0x00000004U
+#define FLASH_SR_WRPRTERR 0x00000010U
+#define FLASH_SR_EOP 0x00000020U
+#define FLASH_CR_PG 0x00000001U
+#define FLASH_CR_PER 0x00000002U
+#define FLASH_CR_STRT 0x00000040U
+#define FLASH_CR_LOCK 0x00000080U
+
+/* USART */
+#define USART_SR_ORE 0x00000008U
+#define USART_SR_IDLE 0x00000010U
+#define USART_SR_RXNE 0x00000020U
+#define USART_SR_TC 0x00000040U
+#define USART_SR_TXE 0x00000080U
+#define USART_CR1_RE 0x00000004U
+#define USART_CR1_TE 0x00000008U
+#define USART_CR1_IDLEIE 0x00000010U
+#define USART_CR1_RXNEIE 0x00000020U
+#define USART_CR1_TCIE 0x00000040U
+#define USART_CR1_TXEIE 0x00000080U
+#define USART_CR1_UE 0x00002000U
+#define USART_CR3_DMAR 0x00000040U
+#define USART_CR3_DMAT 0x00000080U
+
+/* DMA */
+#define DMA_CCR_EN 0x00000001U
+#define DMA_CCR_TCIE 0x00000002U
+#define DMA_CCR_HTIE 0x00000004U
+#define DMA_CCR_TEIE 0x00000008U
+#define DMA_CCR_DIR 0x00000010U
+#define DMA_CCR_CIRC 0x00000020U
+#define DMA_CCR_PINC 0x00000040U
+#define DMA_CCR_MINC 0x00000080U
+#define DMA_CCR_PSIZE 0x00000300U
+#define DMA_CCR_PSIZE_0 0x00000100U
+#define DMA_CCR_PSIZE_1 0x00000200U
+#define DMA_CCR_MSIZE 0x00000C00U
+#define DMA_CCR_MSIZE_0 0x00000400U
+#define DMA_CCR_MSIZE_1 0x00000800U
+#define DMA_CCR_PL 0x00003000U
+#define DMA_CCR_PL_0 0x00001000U
+#define DMA_CCR_PL_1 0x00002000U
+#define DMA_ISR_GIF1 0x00000001U
+#define DMA_ISR_TCIF1 0x00000002U
+#define DMA_ISR_HTIF1 0x00000004U
+#define DMA_ISR_TEIF1 0x00000008U
+#define DMA_ISR_TCIF2 0x00000020U
+#define DMA_ISR_HTIF2 0x00000040U
+#define DMA_ISR_TCIF3 0x00000200U
+#define DMA_ISR_HTIF3 0x00000400U
+#define DMA_ISR_TCIF4 0x00002000U
+#define DMA_ISR_HTIF4 0x00004000U
+#define DMA_ISR_TEIF4 0x00008000U
+#define DMA_ISR_TCIF5 0x00020000U
+#define DMA_ISR_HTIF5 0x00040000U
+#define DMA_ISR_TCIF7 0x02000000U
+#define DMA_ISR_HTIF7 0x04000000U
+#define DMA_IFCR_CGIF2 0x00000010U
+#define DMA_IFCR_CTCIF2 0x00000020U
+#define DMA_IFCR_CHTIF2 0x00000040U
+#define DMA_IFCR_CGIF3 0x00000100U
+#define DMA_IFCR_CTCIF3 0x00000200U
+#define DMA_IFCR_CHTIF3 0x00000400U
+#define DMA_IFCR_CGIF4 0x00001000U
+#define DMA_IFCR_CTCIF4 0x00002000U
+#define DMA_IFCR_CHTIF4 0x00004000U
+#define DMA_IFCR_CTEIF4 0x00008000U
+#define DMA_IFCR_CGIF5 0x00010000U
+#define DMA_IFCR_CTCIF5 0x00020000U
+#define DMA_IFCR_CHTIF5 0x00040000U
+#define DMA_IFCR_CGIF7 0x01000000U
+#define DMA_IFCR_CTCIF7 0x02000000U
+#define DMA_IFCR_CHTIF7 0x04000000U
+
+/* TIM */
+#define TIM_CR1_CEN 0x00000001U
+#define TIM_CR1_UDIS 0x00000002U
+#define TIM_CR1_URS 0x00000004U
+#define TIM_CR1_OPM 0x00000008U
+#define TIM_CR1_DIR 0x00000010U
+#define TIM_CR1_ARPE 0x00000080U
+#define TIM_DIER_UIE 0x00000001U
+#define TIM_DIER_CC1IE 0x00000002U
+#define TIM_DIER_CC2IE 0x00000004U
+#define TIM_DIER_CC3IE 0x00000008U
+#define TIM_DIER_CC4IE 0x00000010U
+#define TIM_DIER_UDE 0x00000100U
+#define TIM_SR_UIF 0x00000001U
+#define TIM_SR_CC1IF 0x00000002U
+#define TIM_SR_CC2IF 0x00000004U
+#define TIM_SR_CC3IF 0x00000008U
+#define TIM_SR_CC4IF 0x00000010U
+#define TIM_EGR_UG 0x00000001U
+#define TIM_CCMR1_OC1PE 0x00000008U
+#define TIM_CCMR1_OC1M 0x00000070U
+#define TIM_CCMR1_OC1M_0 0x00000010U
+#define TIM_CCMR1_OC1M_1 0x00000020U
+#define TIM_CCMR1_OC1M_2 0x00000040U
+#define TIM_CCMR1_OC2PE 0x00000800U
+#define TIM_CCMR1_OC2M 0x00007000U
+#define TIM_CCMR1_OC2M_0 0x00001000U
+#define TIM_CCMR1_OC2M_1 0x00002000U
+#define TIM_CCMR1_OC2M_2 0x00004000U
+#define TIM_CCMR2_OC3PE 0x00000008U
+#define TIM_CCMR2_OC3M 0x00000070U
+#define TIM_CCMR2_OC3M_0 0x00000010U
+#define TIM_CCMR2_OC3M_1 0x00000020U
+#define TIM_CCMR2_OC3M_2 0x00000040U
+#define TIM_CCMR2_OC4PE 0x00000800U
+#define TIM_CCMR2_OC4M 0x00007000U
+#define TIM_CCMR2_OC4M_0 0x00001000U
+#define TIM_CCMR2_OC4M_1 0x00002000U
+#define TIM_CCMR2_OC4M_2 0x00004000U
+#define TIM_CCER_CC1E 0x00000001U
+#define TIM_CCER_CC1P 0x00000002U
+#define TIM_CCER_CC2E 0x00000010U
+#define TIM_CCER_CC2P 0x00000020U
+#define TIM_CCER_CC3E 0x00000100U
+#define TIM_CCER_CC3P 0x00000200U
+#define TIM_CCER_CC4E 0x00001000U
+#define TIM_CCER_CC4P 0x00002000U
+#define TIM_BDTR_MOE 0x00008000U
+
+/* RTC */
+#define RTC_CRH_SECIE 0x00000001U
+#define RTC_CRH_ALRIE 0x00000002U
+#define RTC_CRH_OWIE 0x00000004U
+#define RTC_CRL_SECF 0x00000001U
+#define RTC_CRL_ALRF 0x00000002U
+#define RTC_CRL_OWF 0x00000004U
+#define RTC_CRL_RSF 0x00000008U
+#define RTC_CRL_CNF 0x00000010U
+#define RTC_CRL_RTOFF 0x00000020U
+
+/* Cortex-M3 core */
+#define SCB_SCR_SLEEPONEXIT_Msk 0x00000002U
+#define SCB_SCR_SLEEPDEEP_Msk 0x00000004U
+#define DWT_CTRL_CYCCNTENA_Msk 0x00000001U
+#define CoreDebug_DEMCR_TRCENA_Msk 0x01000000U
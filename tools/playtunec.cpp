@@ -0,0 +1,443 @@
+// Compiles Playtune binaries into the packed tracks MusicPlayer plays
+// (Tones.hpp, Packed.hpp): one array per file, named after the file, in a
+// header the firmware includes as CompiledTracks.h.
+//
+//   playtunec [-v voices] [-b] [-o CompiledTracks.h] track.bin...
+//
+// 'voices' limits the outputs used (all Tones::channels by default), for
+// a board with fewer of them wired up. Statistics go to stderr: sizes, the
+// packing ratio and, with -b, the time Tones::Unpacker takes per event.
+
+#include "../Packed.hpp"
+#include <unistd.h>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace
+{
+	struct Track {
+		std::string name;
+		std::vector<Tones::Event> events;
+		std::vector<uint8_t> packed;
+		uint32_t copies = 0;    // phrases packed as copies
+		size_t inputSize = 0;
+		uint32_t stolen = 0;    // notes cut off for a more important one
+		uint32_t dropped = 0;   // notes that found no voice
+	};
+
+	uint8_t voiceCount = Tones::channels;
+
+	std::string Identifier(const std::string &path) {
+		size_t start = path.find_last_of('/');
+		std::string name = path.substr(start == std::string::npos ? 0 : start + 1);
+		name = name.substr(0, name.find('.'));
+		for (auto &c : name) {
+			if (!isalnum((unsigned char)c))
+				c = '_';
+		}
+		if (name.empty() || isdigit((unsigned char)name[0]))
+			name = "track_" + name;
+		return name;
+	}
+
+	bool Load(const char *path, std::vector<uint8_t> &data) {
+		FILE *file = fopen(path, "rb");
+		if (!file)
+			return false;
+		int c;
+		while ((c = fgetc(file)) != EOF)
+			data.push_back(c);
+		fclose(file);
+		return true;
+	}
+
+	// Plays the bytestream and records what each voice is set to. A tonegen
+	// keeps its voice until its note ends, so a note never moves between
+	// outputs. With all voices busy a new note takes the one of the lowest
+	// priority (the highest tonegen number, as no higher than its own),
+	// the oldest note of those; with none of them, it is dropped. An
+	// instrument change gives the generator's next notes its wave
+	// (Tones::Instrument), which only WAVETABLE builds play.
+	class Compiler {
+	public:
+		Compiler(const std::string &path, Track &track) : path(path), track(track) {
+			voiceOf.fill(none);
+			waveOf.fill(Tones::square);
+		}
+
+		bool Run(const std::vector<uint8_t> &melody) {
+			if (melody.size() < 6 || melody[0] != 'P' || melody[1] != 't' || melody[2] > melody.size())
+				return Fail("not a Playtune file");
+			bool volume = melody[3] & 0x80;
+			size_t i = melody[2];
+			while (i < melody.size()) {
+				uint8_t command = melody[i++];
+				if (!(command & 0x80)) {
+					if (i >= melody.size())
+						return Fail("truncated delay");
+					Flush();
+					pending += (uint32_t)command << 8 | melody[i++];
+					continue;
+				}
+				uint8_t generator = command & 0x0F;
+				switch (command >> 4) {
+				case 0x8:
+					NoteOff(generator);
+					break;
+				case 0x9: {
+						if (i + volume >= melody.size())
+							return Fail("truncated note");
+						uint8_t note = melody[i++];
+						uint8_t duty = volume ? (melody[i++] & 0x7F) + 1 : Tones::defaultDuty;
+						if (note >= Tones::notes) {
+							fprintf(stderr, "%s: note %u out of range, played as a rest\n", path.c_str(), note);
+							note = 0;
+						}
+						if (note)
+							NoteOn(generator, note, duty);
+						else
+							NoteOff(generator);
+						break;
+					}
+				case 0xC:
+					if (i >= melody.size())
+						return Fail("truncated instrument");
+					waveOf[generator] = Tones::Instrument(melody[i++]);   // from its next note on
+					break;
+				case 0xE:
+				case 0xF:
+					i = melody.size();
+					break;
+				default:
+					return Fail("unknown command");
+				}
+			}
+			Flush();
+			Emit(Tones::endOfTrack, 0, 0);
+			return true;
+		}
+
+	private:
+		bool Fail(const char *why) {
+			fprintf(stderr, "%s: %s\n", path.c_str(), why);
+			return false;
+		}
+
+		void NoteOn(uint8_t generator, uint8_t note, uint8_t duty) {
+			uint8_t voice = voiceOf[generator];
+			if (voice == none) {
+				voice = Allocate(generator);
+				if (voice == none) {
+					track.dropped++;
+					return;
+				}
+			}
+			voices[voice] = Voice{ generator, note, waveOf[generator], duty, age++ };
+			voiceOf[generator] = voice;
+		}
+
+		void NoteOff(uint8_t generator) {
+			uint8_t voice = voiceOf[generator];
+			if (voice == none)
+				return;
+			voices[voice] = Voice{};
+			voiceOf[generator] = none;
+		}
+
+		uint8_t Allocate(uint8_t generator) {
+			uint8_t victim = none;
+			for (uint8_t voice = 0; voice < voiceCount; voice++) {
+				const Voice &candidate = voices[voice];
+				if (candidate.generator == none)
+					return voice;
+				if (candidate.generator < generator)
+					continue;
+				if (victim == none || candidate.generator > voices[victim].generator
+					|| (candidate.generator == voices[victim].generator && candidate.started < voices[victim].started))
+					victim = voice;
+			}
+			if (victim != none) {
+				voiceOf[voices[victim].generator] = none;
+				track.stolen++;
+			}
+			return victim;
+		}
+
+		// voices whose note, wave or level changed since the last delay
+		void Flush() {
+			for (uint8_t voice = 0; voice < voiceCount; voice++) {
+				const Voice &now = voices[voice];
+				Voice &sent = out[voice];
+				if (now.note != sent.note || (now.note && (now.wave != sent.wave || now.duty != sent.duty)))
+					Emit(voice, now.note ? now.duty : 0, periods[now.note], now.note ? now.wave : 0);
+				sent = now;
+			}
+		}
+
+		// the end marker goes without a delay, a wait before it keeps that
+		void Emit(uint8_t channel, uint8_t duty, uint32_t period, uint8_t instrument = 0) {
+			if (channel == Tones::endOfTrack && pending)
+				Emit(Tones::wait, 0, 0);
+			while (pending > UINT16_MAX) {
+				track.events.push_back(Tones::Event{ UINT16_MAX, Tones::wait, 0, 0, 0 });
+				pending -= UINT16_MAX;
+			}
+			track.events.push_back(Tones::Event{ (uint16_t)pending, channel, duty, period, instrument });
+			pending = 0;
+		}
+
+		static constexpr uint8_t none = 0xFF;
+		static constexpr auto periods = Tones::Periods();
+
+		struct Voice {
+			uint8_t generator = none;
+			uint8_t note = 0;
+			uint8_t wave = Tones::square;
+			uint8_t duty = Tones::defaultDuty;   // the note's level, from its velocity
+			uint32_t started = 0;
+		};
+
+		const std::string &path;
+		Track &track;
+		std::array<Voice, Tones::channels> voices = {};
+		std::array<uint8_t, Tones::tonegens> voiceOf;   // or none
+		std::array<Tones::Wave, Tones::tonegens> waveOf;   // the generator's instrument
+		std::array<Voice, Tones::channels> out = {};      // as last sent, note 0 is silent
+		uint32_t age = 0;       // orders the notes by start
+		uint32_t pending = 0;   // ms since the last event
+	};
+
+	void Varint(std::vector<uint8_t> &out, uint32_t value) {
+		for (; value >= 0x80; value >>= 7)
+			out.push_back(value | 0x80);
+		out.push_back(value);
+	}
+
+	// one event as a plain token, see Packed.hpp
+	std::vector<uint8_t> Token(const Tones::Event &event) {
+		static constexpr auto periods = Tones::Periods();
+		std::vector<uint8_t> token;
+		uint8_t delay = event.delay ? Tones::Packed::hasDelay : 0;
+		uint8_t voice = event.channel << Tones::Packed::voiceShift;
+		uint8_t note = 0;
+		while (note <= Tones::lastNamedNote && periods[note] != event.period)
+			note++;
+		if (event.channel == Tones::endOfTrack)
+			token.push_back(Tones::Packed::end | delay);
+		else if (event.channel == Tones::wait)
+			token.push_back(Tones::Packed::wait | delay);
+		else if (event.channel < 8 && !event.duty && !event.period && !event.instrument)
+			token.push_back(Tones::Packed::off | voice | delay);
+		else if (event.channel < 8 && event.duty == Tones::defaultDuty && note && note <= Tones::lastNamedNote
+			&& event.instrument <= Tones::Packed::waveMask)
+			token = { (uint8_t)(Tones::Packed::note | voice | delay | event.instrument), note };
+		else if (event.channel < 8 && event.duty && note && note <= Tones::lastNamedNote && event.instrument < 8)
+			token = { (uint8_t)(Tones::Packed::level | delay), (uint8_t)(voice | event.instrument), note, event.duty };
+		else
+			token = { (uint8_t)(Tones::Packed::event | delay), event.channel, event.duty, (uint8_t)event.period,
+				(uint8_t)(event.period >> 8), (uint8_t)(event.period >> 16), (uint8_t)event.instrument };
+		if (delay)
+			Varint(token, event.delay);
+		return token;
+	}
+
+	// Greedy LZ over whole tokens: at each event the longest run of plain
+	// tokens already written that repeats here, at least 'shortest' long,
+	// if a copy is shorter than writing it again. Runs never span a copy,
+	// which Packed.hpp relies on.
+	void Pack(Track &track, const std::vector<std::vector<uint8_t>> &tokens, size_t shortest) {
+		struct Written {
+			size_t token;
+			size_t offset;    // in 'packed'
+			uint32_t run;     // plain tokens with the same run are contiguous
+		};
+		std::vector<Written> written;
+		auto &packed = track.packed;
+		uint32_t run = 0;
+		for (size_t i = 0; i < tokens.size(); ) {
+			size_t bestLength = 0, bestStart = 0, bestBytes = 0;
+			for (size_t start = 0; start < written.size(); start++) {
+				size_t length = 0, bytes = 0;
+				while (length < Tones::Packed::maxCopy && i + length < tokens.size() && start + length < written.size()
+					&& written[start + length].run == written[start].run
+					&& track.events[i + length].channel != Tones::endOfTrack
+					&& tokens[written[start + length].token] == tokens[i + length])
+					bytes += tokens[i + length++].size();
+				if (length > bestLength) {
+					bestLength = length;
+					bestStart = start;
+					bestBytes = bytes;
+				}
+			}
+			if (bestLength >= shortest) {
+				std::vector<uint8_t> copy = { (uint8_t)(Tones::Packed::copy | (bestLength - 1)) };
+				Varint(copy, packed.size() - written[bestStart].offset);
+				if (copy.size() < bestBytes) {
+					packed.insert(packed.end(), copy.begin(), copy.end());
+					track.copies++;
+					run++;
+					i += bestLength;
+					continue;
+				}
+			}
+			written.push_back(Written{ i, packed.size(), run });
+			packed.insert(packed.end(), tokens[i].begin(), tokens[i].end());
+			i++;
+		}
+	}
+
+	// Short copies early on split a phrase into pieces a later repeat of it
+	// cannot copy as a whole; the shortest copy that packs smallest wins.
+	void Pack(Track &track) {
+		std::vector<std::vector<uint8_t>> tokens;
+		for (const auto &event : track.events)
+			tokens.push_back(Token(event));
+		Track best;
+		for (size_t shortest = 1; shortest <= 16; shortest++) {
+			Track candidate;
+			candidate.events = track.events;
+			Pack(candidate, tokens, shortest);
+			if (shortest == 1 || candidate.packed.size() < best.packed.size())
+				best = std::move(candidate);
+		}
+		track.packed = std::move(best.packed);
+		track.copies = best.copies;
+	}
+
+	// the packed track must read back as the events it was packed from
+	bool Check(const Track &track) {
+		Tones::Unpacker reader;
+		reader.Start(track.packed.data());
+		for (const auto &expected : track.events) {
+			Tones::Event event = reader.Take();
+			if (event.delay != expected.delay || event.channel != expected.channel || event.duty != expected.duty
+				|| event.period != expected.period || event.instrument != expected.instrument)
+				return false;
+		}
+		return true;
+	}
+
+	uint64_t Cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return 0;
+#endif
+	}
+
+	// Host time and TSC cycles (0 off x86) per event of a full read of the
+	// track, best of a few rounds. A guide to the Unpacker's cost, not the
+	// board's.
+	struct Speed {
+		double ns;
+		double cycles;
+	};
+
+	Speed Benchmark(const Track &track) {
+		constexpr int passes = 100;
+		Speed best = {};
+		volatile uint32_t sink = 0;   // keeps the reads
+		for (int round = 0; round < 20; round++) {
+			Tones::Unpacker reader;
+			uint32_t checksum = 0;
+			auto start = std::chrono::steady_clock::now();
+			uint64_t startCycles = Cycles();
+			for (int pass = 0; pass < passes; pass++) {
+				reader.Start(track.packed.data());
+				for (size_t i = 0; i < track.events.size(); i++)
+					checksum += reader.Take().period;
+			}
+			double events = (double)passes * track.events.size();
+			Speed speed = { std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / events,
+				(Cycles() - startCycles) / events };
+			sink = checksum;
+			if (!round || speed.ns < best.ns)
+				best = speed;
+		}
+		(void)sink;
+		return best;
+	}
+
+	void Write(FILE *out, const std::vector<Track> &tracks, const std::vector<std::string> &inputs) {
+		fprintf(out, "// Generated by tools/playtunec from");
+		for (const auto &input : inputs)
+			fprintf(out, " %s", input.substr(input.find_last_of('/') + 1).c_str());
+		fprintf(out, ", do not edit.\n#pragma once\n#include <Packed.hpp>\n\n");
+		fprintf(out, "static_assert(Tones::Packed::format == %u && Tones::channels >= %u, \"Packed.hpp changed, rerun tools/playtunec\");\n\n",
+			Tones::Packed::format, voiceCount);
+		fprintf(out, "namespace CompiledTracks\n{\n");
+		for (const auto &track : tracks) {
+			fprintf(out, "\tconstexpr uint8_t %s[] = {", track.name.c_str());
+			for (size_t i = 0; i < track.packed.size(); i++)
+				fprintf(out, "%s0x%02X,", i % 16 ? " " : "\n\t\t", track.packed[i]);
+			fprintf(out, "\n\t};\n");
+		}
+		fprintf(out, "}\n");
+	}
+}
+
+int main(int argc, char **argv) {
+	const char *output = nullptr;
+	bool benchmark = false;
+	int option;
+	while ((option = getopt(argc, argv, "v:bo:")) != -1) {
+		switch (option) {
+		case 'v': voiceCount = strtoul(optarg, nullptr, 0); break;
+		case 'b': benchmark = true; break;
+		case 'o': output = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-v voices] [-b] [-o CompiledTracks.h] track.bin...\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind == argc || !voiceCount || voiceCount > Tones::channels) {
+		fprintf(stderr, "usage: %s [-v voices] [-b] [-o CompiledTracks.h] track.bin...\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<Track> tracks;
+	std::vector<std::string> inputs;
+	for (int i = optind; i < argc; i++) {
+		std::vector<uint8_t> data;
+		if (!Load(argv[i], data)) {
+			perror(argv[i]);
+			return 1;
+		}
+		Track track;
+		track.name = Identifier(argv[i]);
+		track.inputSize = data.size();
+		std::string path = argv[i];
+		if (!Compiler(path, track).Run(data))
+			return 1;
+		Pack(track);
+		if (!Check(track)) {
+			fprintf(stderr, "%s: packed track does not read back\n", argv[i]);
+			return 1;
+		}
+		size_t unpacked = track.events.size() * sizeof(Tones::Event);
+		fprintf(stderr, "%s: %zu bytes, %zu events, %zu bytes packed (%.1fx of %zu, %u copies), %u notes stolen, %u dropped\n",
+			track.name.c_str(), track.inputSize, track.events.size(), track.packed.size(), (double)unpacked / track.packed.size(),
+			unpacked, track.copies, track.stolen, track.dropped);
+		if (benchmark) {
+			Speed speed = Benchmark(track);
+			fprintf(stderr, "%s: read back at %.1f ns, %.1f cycles per event\n", track.name.c_str(), speed.ns, speed.cycles);
+		}
+		tracks.push_back(std::move(track));
+		inputs.push_back(argv[i]);
+	}
+
+	FILE *out = output ? fopen(output, "w") : stdout;
+	if (!out) {
+		perror(output);
+		return 1;
+	}
+	Write(out, tracks, inputs);
+	return out == stdout || !fclose(out) ? 0 : 1;
+}
@@ -0,0 +1,325 @@
+// Decodes the firmware's telemetry frames (Telemetry.hpp) from a capture
+// file, a pipe or a serial port, reports sequence gaps and exports CSV.
+//
+//   teldecode [-b baud] [-c out.csv] [-r raw.bin] [-q] [input]
+//
+// 'input' defaults to stdin; a tty is switched to raw mode at 'baud'
+// (115200 by default). Text between frames (task stats, CSV exports,
+// command replies) is passed through to stdout unless -q is given.
+
+#include "../Telemetry.hpp"
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Options {
+		const char *input = nullptr;
+		const char *csv = nullptr;
+		const char *raw = nullptr;
+		unsigned baud = 115200;
+		bool quiet = false;
+	};
+
+	struct Counters {
+		uint64_t bytes = 0;
+		uint64_t frames = 0;
+		uint64_t malformed = 0;    // bad COBS or CRC that did not look like text
+		uint64_t versions = 0;     // frames of another protocol version
+		uint64_t unsynced = 0;     // deltas before the first keyframe
+		uint64_t gaps = 0;
+		uint64_t lost = 0;
+		uint64_t byType[256] = {};
+	};
+
+	Options options;
+	Counters counters;
+	FILE *csv = nullptr;
+	FILE *raw = nullptr;
+	bool haveSequence = false;
+	uint16_t nextSequence = 0;
+
+	// game state rebuilt from Keyframe and Delta frames
+	int seats = -1;
+	std::vector<int64_t> state;
+	std::vector<bool> known;
+
+	const char *TypeName(uint8_t type) {
+		switch (type) {
+		case Telemetry::Boot: return "boot";
+		case Telemetry::TurnSwitch: return "turn_switch";
+		case Telemetry::Keyframe: return "keyframe";
+		case Telemetry::Delta: return "delta";
+		default: return "unknown";
+		}
+	}
+
+	const char *FieldName(uint8_t field) {
+		static const char *names[] = { "seated", "in_play", "player", "turn_s", "increment_s", "mode", "flags", "remaining_s" };
+		return names[field];
+	}
+
+	std::string FieldLabel(uint8_t field) {
+		if (field < Telemetry::SeatFields)
+			return FieldName(field);
+		uint8_t seat = (field - Telemetry::SeatFields) % seats;
+		return (field < Telemetry::SeatFields + seats ? "score" : "bank_ms") + std::to_string(seat);
+	}
+
+	speed_t Speed(unsigned baud) {
+		switch (baud) {
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 921600: return B921600;
+		case 1000000: return B1000000;
+		case 2000000: return B2000000;
+		default:
+			fprintf(stderr, "teldecode: unsupported baud rate %u\n", baud);
+			exit(2);
+		}
+	}
+
+	void MakeRaw(int fd) {
+		termios tio;
+		if (tcgetattr(fd, &tio) != 0)
+			return;
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, Speed(options.baud));
+		cfsetospeed(&tio, Speed(options.baud));
+		tio.c_cc[VMIN] = 1;
+		tio.c_cc[VTIME] = 0;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+
+	std::string Known(uint8_t field) { return known[field] ? std::to_string(state[field]) : std::string(); }
+
+	std::string SeatList(uint8_t first) {
+		std::string list;
+		for (int seat = 0; seat < seats; seat++) {
+			if (seat)
+				list += ';';
+			list += Known(first + seat);
+		}
+		return list;
+	}
+
+	void CsvHeader() {
+		fprintf(csv, "seq,type,cycles,clock_hz,seats");
+		for (uint8_t field = 0; field < Telemetry::SeatFields; field++)
+			fprintf(csv, ",%s", FieldName(field));
+		fprintf(csv, ",scores,banks_ms\n");
+	}
+
+	// Keyframe and Delta: apply the fields; CSV gets the whole state after it
+	bool Fields(const Telemetry::Header &header, Telemetry::Reader &reader, std::string &changes) {
+		if (header.type == Telemetry::Keyframe) {
+			int frameSeats = reader.Get8();
+			if (frameSeats != seats) {
+				seats = frameSeats;
+				state.assign(Telemetry::FieldCount(seats), 0);
+				known.assign(Telemetry::FieldCount(seats), false);
+			}
+		}
+		else if (seats < 0) {
+			counters.unsynced++;
+			return false;
+		}
+		auto mask = reader.GetBits<Telemetry::maxFields>();
+		for (uint8_t field = 0; field < Telemetry::maxFields; field++) {
+			if (!mask[field])
+				continue;
+			int64_t value = reader.GetSigned();
+			if (field >= state.size()) {
+				reader.overrun = true;
+				break;
+			}
+			state[field] = value;
+			known[field] = true;
+			changes += " " + FieldLabel(field) + "=" + std::to_string(value);
+		}
+		return true;
+	}
+
+	// one CSV row and, unless quiet, one readable line per frame
+	void Frame(const Telemetry::Header &header, const uint8_t *payload) {
+		Telemetry::Reader reader(payload, header.payloadSize);
+		std::string cycles, clock, bootSeats, changes;
+		bool game = false;
+		switch (header.type) {
+		case Telemetry::Boot:
+			bootSeats = std::to_string(reader.Get8());
+			clock = std::to_string(reader.Get32());
+			changes = " seats=" + bootSeats + " clock_hz=" + clock;
+			break;
+		case Telemetry::TurnSwitch:
+			cycles = std::to_string(reader.Get32());
+			changes = " cycles=" + cycles;
+			break;
+		case Telemetry::Keyframe:
+		case Telemetry::Delta:
+			if (!Fields(header, reader, changes))
+				return;
+			game = true;
+			break;
+		default:
+			break;
+		}
+		if (reader.overrun || !reader.Done()) {
+			counters.malformed++;
+			return;
+		}
+		counters.frames++;
+		counters.byType[header.type]++;
+		if (csv) {
+			fprintf(csv, "%u,%s,%s,%s,%s", header.sequence, TypeName(header.type), cycles.c_str(), clock.c_str(),
+				game ? std::to_string(seats).c_str() : bootSeats.c_str());
+			for (uint8_t field = 0; field < Telemetry::SeatFields; field++)
+				fprintf(csv, ",%s", game ? Known(field).c_str() : "");
+			fprintf(csv, ",%s,%s\n", game ? SeatList(Telemetry::ScoreField(0)).c_str() : "",
+				game ? SeatList(Telemetry::BankField(seats, 0)).c_str() : "");
+		}
+		if (!options.quiet)
+			printf("#%05u %-11s%s\n", header.sequence, TypeName(header.type), changes.c_str());
+	}
+
+	void Sequence(uint16_t sequence) {
+		if (haveSequence && sequence != nextSequence) {
+			uint16_t missing = sequence - nextSequence;
+			counters.gaps++;
+			counters.lost += missing;
+			fprintf(stderr, "teldecode: gap before #%u, %u frame(s) lost\n", sequence, missing);
+		}
+		haveSequence = true;
+		nextSequence = sequence + 1;
+	}
+
+	bool Printable(const std::vector<uint8_t> &block) {
+		for (uint8_t c : block) {
+			if ((c < 0x20 || c > 0x7E) && c != '\r' && c != '\n' && c != '\t')
+				return false;
+		}
+		return true;
+	}
+
+	// everything between two 0x00 bytes
+	void Block(std::vector<uint8_t> &block) {
+		if (block.empty())
+			return;
+		std::vector<uint8_t> copy;
+		bool text = Printable(block);
+		if (text)
+			copy = block;
+		uint16_t length = block.size() <= Telemetry::maxEncoded ? Telemetry::CobsDecode(block.data(), block.size()) : 0;
+		Telemetry::Header header;
+		if (length && Telemetry::Parse(block.data(), length, header)) {
+			if (header.version != Telemetry::version) {
+				counters.versions++;
+				return;
+			}
+			Sequence(header.sequence);
+			Frame(header, block.data() + Telemetry::headerSize);
+		}
+		else if (text) {
+			if (!options.quiet)
+				fwrite(copy.data(), 1, copy.size(), stdout);
+		}
+		else
+			counters.malformed++;
+	}
+
+	void Usage() {
+		fprintf(stderr, "usage: teldecode [-b baud] [-c out.csv] [-r raw.bin] [-q] [input]\n");
+		exit(2);
+	}
+}
+
+int main(int argc, char **argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "b:c:r:qh")) != -1) {
+		switch (opt) {
+		case 'b': options.baud = strtoul(optarg, nullptr, 10); break;
+		case 'c': options.csv = optarg; break;
+		case 'r': options.raw = optarg; break;
+		case 'q': options.quiet = true; break;
+		default: Usage();
+		}
+	}
+	if (optind < argc)
+		options.input = argv[optind++];
+	if (optind < argc)
+		Usage();
+
+	int fd = STDIN_FILENO;
+	if (options.input && strcmp(options.input, "-") != 0) {
+		fd = open(options.input, O_RDONLY | O_NOCTTY);
+		if (fd < 0) {
+			perror(options.input);
+			return 1;
+		}
+	}
+	if (isatty(fd))
+		MakeRaw(fd);
+	if (options.csv) {
+		csv = fopen(options.csv, "w");
+		if (!csv) {
+			perror(options.csv);
+			return 1;
+		}
+		CsvHeader();
+	}
+	if (options.raw && !(raw = fopen(options.raw, "wb"))) {
+		perror(options.raw);
+		return 1;
+	}
+
+	// big reads keep up with any serial rate; blocks are split on 0x00
+	auto start = std::chrono::steady_clock::now();
+	std::vector<uint8_t> input(1 << 16);
+	std::vector<uint8_t> block;
+	block.reserve(Telemetry::maxEncoded);
+	ssize_t got;
+	while ((got = read(fd, input.data(), input.size())) > 0) {
+		counters.bytes += got;
+		if (raw)
+			fwrite(input.data(), 1, got, raw);
+		for (ssize_t i = 0; i < got; i++) {
+			if (input[i])
+				block.push_back(input[i]);
+			else {
+				Block(block);
+				block.clear();
+			}
+		}
+		fflush(stdout);
+	}
+	Block(block);
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	fprintf(stderr, "teldecode: %llu bytes, %llu frames, %llu gaps (%llu lost), %llu malformed, %llu other version,"
+		" %llu before the first keyframe, %.1f MB/s\n",
+		(unsigned long long)counters.bytes, (unsigned long long)counters.frames, (unsigned long long)counters.gaps,
+		(unsigned long long)counters.lost, (unsigned long long)counters.malformed, (unsigned long long)counters.versions,
+		(unsigned long long)counters.unsynced,
+		seconds > 0 ? counters.bytes / seconds / 1e6 : 0.0);
+	for (int type = 0; type < 256; type++) {
+		if (counters.byType[type])
+			fprintf(stderr, "  %-11s %llu\n", TypeName(type), (unsigned long long)counters.byType[type]);
+	}
+	if (csv)
+		fclose(csv);
+	if (raw)
+		fclose(raw);
+	return 0;
+}
@@ -0,0 +1,175 @@
+// Replays a game through the firmware's GameEngine and Publisher on the
+// host and measures the telemetry a DEBUG build sends, against the
+// baseline's DEBUG dump: 8 bytes every 100 ms of a turn.
+//
+//   telreplay [-m minutes] [-t turn_s] [-p pause_every] [-o out.bin]
+//
+// Six players take turns of 'turn_s' on average (23 by default, spread
+// +-50% from a fixed seed), each followed by 2 s of scoring. With -p every
+// 'pause_every'-th turn is paused for 30 s halfway. Report() runs after
+// every event and, as TurnWait() has it, every 100 ms of a turn. The
+// frames go to 'out.bin' for tools/teldecode.
+
+#include <unistd.h>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using TickType_t = uint32_t;
+#define pdMS_TO_TICKS(ms) (ms)
+
+// the RTC's 1024 Hz, stepped by the replay
+namespace Periph
+{
+	struct Rtc {
+		static constexpr uint32_t frequency = 1024;
+		static inline uint32_t now = 0;
+		static inline uint32_t Now() { return now; }
+	};
+}
+
+#include "../GameEngine.hpp"
+#include "../Publisher.hpp"
+
+namespace
+{
+	struct Options {
+		uint32_t minutes = 60;
+		uint32_t turnSeconds = 23;
+		uint32_t pauseEvery = 0;
+		const char *output = nullptr;
+	};
+
+	struct Counters {
+		uint64_t frames = 0;
+		uint64_t bytes = 0;
+		uint64_t turnSwitchBytes = 0;
+		uint64_t turns = 0;
+		uint64_t turnMs = 0;    // time spent in a turn, what the baseline dumped through
+	};
+
+	constexpr uint32_t reportMs = 100;
+	constexpr uint32_t scoringMs = 2000;
+	constexpr uint32_t pauseMs = 30000;
+	constexpr uint32_t baselineFrame = 8;
+
+	Options options;
+	Counters counters;
+	FILE *output = nullptr;
+	uint32_t nowMs = 0;
+	uint16_t sequence = 0;
+	GameEngine engine;
+	Publisher<GameEngine> publisher;
+
+	void Send(Telemetry::Frame &frame) {
+		std::array<uint8_t, Telemetry::maxEncoded> encoded;
+		uint16_t size = frame.Encode(sequence++, encoded);
+		counters.frames++;
+		counters.bytes += size;
+		if (output)
+			fwrite(encoded.data(), 1, size, output);
+	}
+
+	void Advance(uint32_t ms) {
+		nowMs += ms;
+		Periph::Rtc::now = (uint64_t)nowMs * Periph::Rtc::frequency / 1000;
+	}
+
+	// publishes after every step, as the game task does after every event
+	void Report() {
+		GameEngine::Publish();
+		publisher.Update(GameEngine::Read(), nowMs, Send);
+	}
+
+	// a turn clock running for 'ms', woken every reportMs
+	void Run(uint32_t ms) {
+		for (uint32_t step = 0; step < ms; step += reportMs) {
+			Advance(std::min(reportMs, ms - step));
+			Report();
+		}
+		counters.turnMs += ms;
+	}
+
+	void Usage() {
+		fprintf(stderr, "usage: telreplay [-m minutes] [-t turn_s] [-p pause_every] [-o out.bin]\n");
+		exit(2);
+	}
+}
+
+int main(int argc, char **argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "m:t:p:o:h")) != -1) {
+		switch (opt) {
+		case 'm': options.minutes = strtoul(optarg, nullptr, 10); break;
+		case 't': options.turnSeconds = strtoul(optarg, nullptr, 10); break;
+		case 'p': options.pauseEvery = strtoul(optarg, nullptr, 10); break;
+		case 'o': options.output = optarg; break;
+		default: Usage();
+		}
+	}
+	if (optind < argc || !options.minutes || !options.turnSeconds)
+		Usage();
+	if (options.output && !(output = fopen(options.output, "wb"))) {
+		perror(options.output);
+		return 1;
+	}
+
+	// as the buttons would set it up: six seats, 60 s turns, scores on
+	for (uint8_t seat = 0; seat < GameEngine::maxPlayers; seat++)
+		GameEngine::AddPlayer();
+	GameEngine::SetTurnTime(60);
+	GameEngine::countScores = true;
+	Report();
+	GameEngine::StartGame();
+	GameEngine::StartTurnTimer();
+	Report();
+
+	std::mt19937 random(1);
+	std::uniform_int_distribution<uint32_t> turnLength(options.turnSeconds * 500, options.turnSeconds * 1500);
+	std::uniform_int_distribution<int32_t> score(0, 3);
+	uint32_t endMs = options.minutes * 60000;
+	while (nowMs < endMs) {
+		uint32_t length = turnLength(random);
+		counters.turns++;
+		if (options.pauseEvery && counters.turns % options.pauseEvery == 0) {
+			Run(length / 2);
+			GameEngine::turnClock.Pause();
+			Report();
+			Advance(pauseMs);
+			Report();
+			GameEngine::turnClock.Resume();
+			Report();
+			Run(length - length / 2);
+		}
+		else
+			Run(length);
+
+		GameEngine::EndTurn();
+		Report();
+		Advance(scoringMs);
+		GameEngine::ChangeScore(score(random));
+		GameEngine::NextPlayer();
+		GameEngine::StartTurnTimer();
+		Telemetry::Frame turnSwitch(Telemetry::TurnSwitch);
+		uint64_t before = counters.bytes;
+		Send(turnSwitch.Put32(0));
+		counters.turnSwitchBytes += counters.bytes - before;
+		Report();
+	}
+	if (output)
+		fclose(output);
+
+	double hours = nowMs / 3600000.0;
+	uint64_t baseline = counters.turnMs / reportMs * baselineFrame;
+	printf("telreplay: %.1f min, %llu turns of %u s mean, %u seats\n", nowMs / 60000.0, (unsigned long long)counters.turns,
+		options.turnSeconds, (unsigned)GameEngine::maxPlayers);
+	printf("  telemetry  %llu bytes in %llu frames, %.1f KB/h (%.1f KB/h of it turn_switch)\n", (unsigned long long)counters.bytes,
+		(unsigned long long)counters.frames, counters.bytes / hours / 1000, counters.turnSwitchBytes / hours / 1000);
+	printf("  baseline   %llu bytes, %.1f KB/h (%u bytes every %u ms of a turn)\n", (unsigned long long)baseline,
+		baseline / hours / 1000, baselineFrame, reportMs);
+	printf("  ratio      %.1fx fewer bytes\n", counters.bytes ? (double)baseline / counters.bytes : 0.0);
+	return 0;
+}
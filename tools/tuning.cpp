@@ -0,0 +1,91 @@
+// Tuning report for the tone outputs: for every note of pitches[] the
+// frequency really produced, with the old PSC-only divider (ARR fixed at
+// 1000) and with the voices' fixed-point periods (Tones.hpp), and its
+// error against equal temperament in cents.
+//
+//   tuning [-c clock] [-q]
+//
+// 'clock' is SYSCLK in Hz for the old divider (72000000 by default); -q
+// prints only the summary. The summary is the benchmark: worst and mean
+// error, and how many neighbouring semitones collapse onto one divider.
+
+#include "../Tones.hpp"
+#include <unistd.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+	// built by the compiler, as in tools/playtunec
+	constexpr auto periods = Tones::Periods();
+	static_assert(periods[Tones::noteA4] == Tones::Period(440), "A4 should be 440 Hz");
+
+	const char *names[] = { "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B" };
+
+	struct Summary {
+		double worst = 0;
+		double total = 0;
+		int collisions = 0;
+	};
+
+	double Cents(double actual, double ideal) { return 1200 * std::log2(actual / ideal); }
+
+	double Produced(uint32_t clock, uint32_t psc, uint32_t arr) { return (double)clock / ((psc + 1.0) * (arr + 1.0)); }
+
+	// the average over many periods, the fraction carries from edge to edge
+	double Produced(uint32_t period) { return Tones::clock * (double)(1 << Tones::periodShift) / period; }
+
+	void Account(Summary &summary, double cents, bool collides) {
+		summary.worst = std::fmax(summary.worst, std::fabs(cents));
+		summary.total += std::fabs(cents);
+		summary.collisions += collides;
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t clock = 72000000;
+	bool quiet = false;
+	int option;
+	while ((option = getopt(argc, argv, "c:q")) != -1) {
+		switch (option) {
+		case 'c': clock = strtoul(optarg, nullptr, 0); break;
+		case 'q': quiet = true; break;
+		default:
+			fprintf(stderr, "usage: %s [-c clock] [-q]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (!clock) {
+		fprintf(stderr, "usage: %s [-c clock] [-q]\n", argv[0]);
+		return 2;
+	}
+
+	Summary old, solved;
+	uint32_t previousPsc = 0, previous = 0;
+	int counted = 0;
+	if (!quiet)
+		printf("note  ideal Hz   old PSC  old Hz     cents    period/256  Hz         cents\n");
+	for (uint8_t note = 1; note <= Tones::lastNamedNote; note++) {
+		double ideal = Tones::Ideal(note);
+		uint32_t oldPsc = clock / 1000 / pitches[note] - 1;   // PWM_SetFrequency with ARR 1000
+		double oldHz = Produced(clock, oldPsc, 1000);
+		uint32_t period = periods[note];
+		double hz = Produced(period);
+		double oldCents = Cents(oldHz, ideal), cents = Cents(hz, ideal);
+		bool oldCollides = note > 1 && oldPsc == previousPsc;
+		bool collides = note > 1 && period == previous;
+		Account(old, oldCents, oldCollides);
+		Account(solved, cents, collides);
+		counted++;
+		if (!quiet)
+			printf("%-3s%d  %9.3f  %6u  %9.3f  %+7.2f%s  %10u  %9.3f  %+7.4f%s\n", names[(note - 1) % 12], (note - 1) / 12, ideal,
+				(unsigned)oldPsc, oldHz, oldCents, oldCollides ? "*" : " ", (unsigned)period, hz, cents, collides ? "*" : "");
+		previousPsc = oldPsc;
+		previous = period;
+	}
+	printf("%d notes, old divider at %lu Hz, * = same divider as the semitone below\n", counted, (unsigned long)clock);
+	printf("old PSC only: worst %.2f cents, mean %.2f cents, %d collisions\n", old.worst, old.total / counted, old.collisions);
+	printf("voices:       worst %.4f cents, mean %.4f cents, %d collisions\n", solved.worst, solved.total / counted, solved.collisions);
+	return 0;
+}
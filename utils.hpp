@@ -2,6 +2,8 @@
 #define UTILS_H
 #include "assert.h"
 #include <array>
+#include <cstddef>
+#include <cstdint>
 
 namespace utils {
 
@@ -28,6 +30,17 @@ namespace utils {
 		assert((sizeof(T) * 8U) > bit);
 		return !((value & (static_cast<T>(1) << static_cast<T>(bit))) == static_cast<T>(0U));
 	};
+
+	// CRC-16/CCITT-FALSE; pass the previous result as 'crc' to continue over more data
+	inline uint16_t crc16(const void *data, size_t size, uint16_t crc = 0xFFFF) {
+		auto bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			crc ^= static_cast<uint16_t>(bytes[i] << 8);
+			for (uint8_t bit = 0; bit < 8; bit++)
+				crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+		}
+		return crc;
+	};
 };
 
 #endif